@@ -0,0 +1,426 @@
+// -----------------------------------------------------------------------------
+// MorpheBench.cpp - C++ File
+//    Evaluation benchmark on synthetic meshes, without Maya. Prints one CSV
+//    row per run on stdout; notes go to stderr.
+// -----------------------------------------------------------------------------
+
+
+//
+// Includes
+//
+#include "MorpheAccumulator.h"
+#include "MorpheItem.h"
+#include "MorpheKernels.h"
+#include "MorpheThreadPool.h"
+#include "MorpheTiles.h"
+#include "MorpheWeightIndex.h"
+#include "MorpheWeightMap.h"
+
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+// -----------------------------------------------------------------------------
+
+
+//
+// Settings - Command line options
+//
+struct Settings
+{
+   std::vector<unsigned int>  vertexCounts;
+   std::vector<unsigned int>  threadCounts;     // 0 for all cores
+   unsigned int               targetCount;
+   float                      sparsity;         // Fraction of the vertices moved by a target
+   float                      active;           // Fraction of the weights not zero
+   unsigned int               iterations;
+   unsigned int               seed;
+   unsigned int               maxReferenceMB;   // Reference runs needing more are skipped
+   bool                       quantize;
+   const char                 *kernels;
+};
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    Deterministic random numbers, so every release benchmarks the same data.
+//
+static unsigned int gRandom = 1;
+
+static unsigned int Random()
+{
+   gRandom = gRandom * 1664525u + 1013904223u;
+   return gRandom >> 8;
+}
+
+static float RandomFloat(float fMin, float fMax)
+{
+   return fMin + (fMax - fMin) * (Random() & 0xFFFF) / 65535.0f;
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Synthetic rig: a base grid, one full target point array per weight for the
+//    reference, and the matching morphe items
+//
+struct Scene
+{
+   unsigned int               vertexCount;
+   std::vector<float>         baseXYZ;
+   std::vector<double>        referenceTargets;  // Full xyz per target, as pulled from target meshes
+   bool                       hasReference;
+   MorpheItemMap              items;
+   MorpheWeightIndex          index;
+   MorpheWeightMap            weightMap;
+   std::vector<float>         weights;
+};
+
+static void BuildScene(const Settings &settings, unsigned int uVertexCount, bool bQuantize, Scene &scene)
+{
+   gRandom = settings.seed;
+
+   scene.vertexCount = uVertexCount;
+   scene.baseXYZ.resize(uVertexCount * 3);
+   unsigned int uSide = (unsigned int)sqrtf((float)uVertexCount) + 1;
+   for(unsigned int j = 0; j < uVertexCount; j++)
+   {
+      scene.baseXYZ[3*j]   = (float)(j % uSide);
+      scene.baseXYZ[3*j+1] = RandomFloat(-0.1f, 0.1f);
+      scene.baseXYZ[3*j+2] = (float)(j / uSide);
+   }
+
+   double dReferenceMB = (double)uVertexCount * settings.targetCount * 3 * sizeof(double) / (1024.0 * 1024.0);
+   scene.hasReference = dReferenceMB <= settings.maxReferenceMB;
+   scene.referenceTargets.clear();
+   if(scene.hasReference)
+      scene.referenceTargets.resize((size_t)uVertexCount * settings.targetCount * 3);
+   else
+      fprintf(stderr, "note: reference skipped for %u vertices, it needs %.0f MB\n", uVertexCount, dReferenceMB);
+
+   // Each target moves a contiguous band of the grid
+   unsigned int uMoved = (unsigned int)(uVertexCount * settings.sparsity);
+   std::vector<float> targetXYZ;
+   scene.items.clear();
+   scene.index.Clear();
+   for(unsigned int t = 0; t < settings.targetCount; t++)
+   {
+      targetXYZ = scene.baseXYZ;
+      unsigned int uFirst = uVertexCount > 0 ? Random() % uVertexCount : 0;
+      for(unsigned int m = 0; m < uMoved; m++)
+      {
+         unsigned int j = (uFirst + m) % uVertexCount;
+         targetXYZ[3*j]   += RandomFloat(-1.0f, 1.0f);
+         targetXYZ[3*j+1] += RandomFloat(-1.0f, 1.0f);
+         targetXYZ[3*j+2] += RandomFloat(-1.0f, 1.0f);
+      }
+
+      if(scene.hasReference)
+      {
+         double *pRef = &scene.referenceTargets[(size_t)t * uVertexCount * 3];
+         for(unsigned int k = 0; k < uVertexCount * 3; k++)
+            pRef[k] = targetXYZ[k];
+      }
+
+      int iWeightId = (int)t;
+      MorpheItem &item = scene.items[t];
+      item.SetWeightIds(&iWeightId, 1);
+      item.target.Build(&targetXYZ[0], &scene.baseXYZ[0], uVertexCount, uVertexCount, MORPHE_ZERO_THRESHOLD);
+      if(bQuantize)
+         item.Quantize();
+      scene.index.SetItem(t, &iWeightId, 1);
+   }
+
+   // Active weights and a fully painted deformer
+   scene.weights.assign(settings.targetCount, 0.0f);
+   unsigned int uActive = (unsigned int)(settings.targetCount * settings.active + 0.5f);
+   for(unsigned int a = 0; a < uActive; a++)
+      scene.weights[Random() % settings.targetCount] = RandomFloat(0.1f, 1.0f);
+
+   scene.weightMap.Reset(uVertexCount, 1.0f);
+   scene.weightMap.Finalize();
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    Reference evaluation, the plug-in logic before the core library: every
+//      item is visited, every active target is walked over all vertices in
+//      double precision, and every point is written back.
+//
+static void EvaluateReference(const Settings &settings, const Scene &scene, std::vector<double> &deltas, std::vector<double> &points)
+{
+   unsigned int uVertexCount = scene.vertexCount;
+   deltas.assign(uVertexCount * 3, 0.0);
+
+   for(unsigned int t = 0; t < settings.targetCount; t++)
+   {
+      double wt = scene.weights[t];
+      if(wt == 0.0)
+         continue;
+
+      const double *pTarget = &scene.referenceTargets[(size_t)t * uVertexCount * 3];
+      for(unsigned int k = 0; k < uVertexCount * 3; k++)
+         deltas[k] += (pTarget[k] - scene.baseXYZ[k]) * wt;
+   }
+
+   points.resize(uVertexCount * 3);
+   for(unsigned int j = 0; j < uVertexCount; j++)
+   {
+      double wt = scene.weightMap.values[j];
+      points[3*j]   = scene.baseXYZ[3*j]   + deltas[3*j]   * wt;
+      points[3*j+1] = scene.baseXYZ[3*j+1] + deltas[3*j+1] * wt;
+      points[3*j+2] = scene.baseXYZ[3*j+2] + deltas[3*j+2] * wt;
+   }
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    Core evaluation, as MorpheNode::deform does it. With tiles the targets
+//      are accumulated tile by tile.
+//
+static void EvaluateMorphe(const Scene &scene, MorpheParallel *pParallel, MorpheTiles *pTiles, MorpheDeltas &deltas, std::vector<float> &points)
+{
+   MorpheActiveArray active;
+   MorpheTermArray   terms;
+   scene.index.GetActive(scene.weights, active);
+   for(size_t a = 0; a < active.size(); a++)
+   {
+      MorpheItemMap::const_iterator it = scene.items.find(active[a].item);
+      if(it != scene.items.end())
+         it->second.GetTerms(active[a].weight, 1.0f, terms);
+   }
+
+   deltas.Resize(scene.vertexCount);
+   if(pTiles != NULL)
+      pTiles->Accumulate(terms, deltas, pParallel);
+   else
+      MorpheAccumulate(terms, deltas, pParallel);
+
+   points = scene.baseXYZ;
+   for(size_t k = 0; k < scene.weightMap.indices.size(); k++)
+   {
+      unsigned int j  = scene.weightMap.indices[k];
+      float        wt = scene.weightMap.values[j];
+      points[3*j]   += deltas.x[j] * wt;
+      points[3*j+1] += deltas.y[j] * wt;
+      points[3*j+2] += deltas.z[j] * wt;
+   }
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Timing of a run
+//
+struct Timing
+{
+   double   meanMs;
+   double   minMs;
+};
+
+template <class Eval>
+static Timing Measure(unsigned int uIterations, Eval eval)
+{
+   typedef std::chrono::steady_clock Clock;
+
+   Timing timing;
+   timing.meanMs = 0.0;
+   timing.minMs  = 0.0;
+
+   eval();  // Warm up
+   for(unsigned int i = 0; i < uIterations; i++)
+   {
+      Clock::time_point start = Clock::now();
+      eval();
+      double dMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+      timing.meanMs += dMs;
+      if(i == 0 || dMs < timing.minMs)
+         timing.minMs = dMs;
+   }
+   if(uIterations > 0)
+      timing.meanMs /= uIterations;
+   return timing;
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    Prints one result row, see the header printed by main.
+//
+static void PrintRow(const char *pMode, const char *pStorage, const Settings &settings, unsigned int uVertexCount,
+                     unsigned int uThreads, const Timing &timing, size_t uMemory, double dMaxError)
+{
+   double dThroughput = timing.meanMs > 0.0 ? uVertexCount / (timing.meanMs * 1000.0) : 0.0;
+   printf("%s,%s,%s,%u,%u,%g,%g,%u,%.4f,%.4f,%.2f,%lu,",
+          pMode, pStorage, MorpheGetKernels().name, uVertexCount, settings.targetCount, settings.sparsity, settings.active,
+          uThreads, timing.meanMs, timing.minMs, dThroughput, (unsigned long)uMemory);
+   if(dMaxError >= 0.0)
+      printf("%g\n", dMaxError);
+   else
+      printf("\n");
+   fflush(stdout);
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    Parses a comma separated list of unsigned integers.
+//
+static std::vector<unsigned int> ParseList(const char *pList)
+{
+   std::vector<unsigned int> values;
+   const char *p = pList;
+   while(*p)
+   {
+      values.push_back((unsigned int)strtoul(p, (char**)&p, 10));
+      if(*p == ',')
+         p++;
+      else if(*p)
+         break;
+   }
+   return values;
+}
+
+static void PrintUsage()
+{
+   fprintf(stderr,
+      "usage: morphe_bench [options]\n"
+      "   --vertices N,N,...     base vertex counts (10000,100000,1000000)\n"
+      "   --targets N            targets, one weight each (200)\n"
+      "   --sparsity F           fraction of the vertices a target moves (0.05)\n"
+      "   --active F             fraction of the weights not zero (0.1)\n"
+      "   --threads N,N,...      thread counts, 0 for all cores (1,2,4,0)\n"
+      "   --iterations N         timed evaluations per run (20)\n"
+      "   --seed N               random seed (1)\n"
+      "   --kernels NAME         scalar, sse or avx2 (best for this CPU)\n"
+      "   --quantize             also run with quantized targets\n"
+      "   --max-reference-mb N   skip reference runs needing more memory (2048)\n");
+}
+// -----------------------------------------------------------------------------
+
+
+int main(int argc, char **argv)
+{
+   Settings settings;
+   settings.vertexCounts   = ParseList("10000,100000,1000000");
+   settings.threadCounts   = ParseList("1,2,4,0");
+   settings.targetCount    = 200;
+   settings.sparsity       = 0.05f;
+   settings.active         = 0.1f;
+   settings.iterations     = 20;
+   settings.seed           = 1;
+   settings.maxReferenceMB = 2048;
+   settings.quantize       = false;
+   settings.kernels        = NULL;
+
+   for(int i = 1; i < argc; i++)
+   {
+      bool bValue = i + 1 < argc;
+      if(strcmp(argv[i], "--vertices") == 0 && bValue)
+         settings.vertexCounts = ParseList(argv[++i]);
+      else if(strcmp(argv[i], "--targets") == 0 && bValue)
+         settings.targetCount = (unsigned int)atoi(argv[++i]);
+      else if(strcmp(argv[i], "--sparsity") == 0 && bValue)
+         settings.sparsity = (float)atof(argv[++i]);
+      else if(strcmp(argv[i], "--active") == 0 && bValue)
+         settings.active = (float)atof(argv[++i]);
+      else if(strcmp(argv[i], "--threads") == 0 && bValue)
+         settings.threadCounts = ParseList(argv[++i]);
+      else if(strcmp(argv[i], "--iterations") == 0 && bValue)
+         settings.iterations = (unsigned int)atoi(argv[++i]);
+      else if(strcmp(argv[i], "--seed") == 0 && bValue)
+         settings.seed = (unsigned int)atoi(argv[++i]);
+      else if(strcmp(argv[i], "--kernels") == 0 && bValue)
+         settings.kernels = argv[++i];
+      else if(strcmp(argv[i], "--max-reference-mb") == 0 && bValue)
+         settings.maxReferenceMB = (unsigned int)atoi(argv[++i]);
+      else if(strcmp(argv[i], "--quantize") == 0)
+         settings.quantize = true;
+      else
+      {
+         PrintUsage();
+         return 1;
+      }
+   }
+
+   if(settings.kernels != NULL && !MorpheSelectKernels(settings.kernels))
+   {
+      fprintf(stderr, "error: kernels %s are not supported here\n", settings.kernels);
+      return 1;
+   }
+   if(settings.sparsity < 0.0f || settings.sparsity > 1.0f || settings.active < 0.0f || settings.active > 1.0f)
+   {
+      fprintf(stderr, "error: sparsity and active must be within [0, 1]\n");
+      return 1;
+   }
+
+   printf("mode,storage,kernels,vertices,targets,sparsity,active,threads,ms_mean,ms_min,mverts_per_s,memory_bytes,max_error\n");
+
+   for(size_t v = 0; v < settings.vertexCounts.size(); v++)
+   {
+      unsigned int uVertexCount = settings.vertexCounts[v];
+      for(int q = 0; q < (settings.quantize ? 2 : 1); q++)
+      {
+         Scene scene;
+         BuildScene(settings, uVertexCount, q == 1, scene);
+         const char *pStorage = q == 1 ? "q16" : "float";
+
+         // Reference, single threaded like the plug-in it replaces
+         std::vector<double> refDeltas, refPoints;
+         if(scene.hasReference && q == 0)
+         {
+            Timing timing = Measure(settings.iterations, [&]() { EvaluateReference(settings, scene, refDeltas, refPoints); });
+            PrintRow("reference", "double", settings, uVertexCount, 1, timing,
+                     (scene.referenceTargets.size() + scene.baseXYZ.size()) * sizeof(double), -1.0);
+         }
+         else if(scene.hasReference)
+         {
+            EvaluateReference(settings, scene, refDeltas, refPoints);
+         }
+
+         size_t uMemory = 0;
+         for(MorpheItemMap::const_iterator it = scene.items.begin(); it != scene.items.end(); it++)
+            uMemory += it->second.MemorySize();
+
+         for(size_t t = 0; t < settings.threadCounts.size(); t++)
+         {
+            MorpheThreadPool   pool(settings.threadCounts[t]);
+            for(int m = 0; m < 2; m++)
+            {
+               MorpheTiles        tiles;
+               MorpheTiles        *pTiles = m == 1 ? &tiles : NULL;
+               MorpheDeltas       deltas;
+               std::vector<float> points;
+               Timing timing = Measure(settings.iterations, [&]() { EvaluateMorphe(scene, &pool, pTiles, deltas, points); });
+
+               double dMaxError = -1.0;
+               if(scene.hasReference)
+               {
+                  dMaxError = 0.0;
+                  for(size_t k = 0; k < points.size(); k++)
+                  {
+                     double dError = fabs(points[k] - refPoints[k]);
+                     if(dError > dMaxError)
+                        dMaxError = dError;
+                  }
+               }
+               PrintRow(m == 1 ? "tiled" : "morphe", pStorage, settings, uVertexCount, pool.ThreadCount(), timing,
+                        uMemory + tiles.MemorySize(), dMaxError);
+            }
+         }
+      }
+   }
+
+   return 0;
+}
+// -----------------------------------------------------------------------------
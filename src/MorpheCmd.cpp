@@ -8,91 +8,673 @@
 //
 #include "MorpheCmd.h"
 #include "MorpheNode.h"
+
+#include <algorithm>
 // -----------------------------------------------------------------------------
 
 
 //
 // Description:
-//    This method add weight attributes to the node deformer.
+//    This method queues a weight attribute of the node deformer and its alias.
 //
-void MorpheCmd::AddWeight(MObject &obj, MObject &objDeformer, unsigned int &idx)
+void MorpheCmd::AddWeight(MDGModifier &modifier, const MPlug &plugWeight, const MString &name)
 {
-   MFnDependencyNode fnObj(obj);
-   MFnDependencyNode fnDeformer(objDeformer);
-   MPlug             plugArrWeight(fnDeformer.findPlug(MorpheNode::aWeight));
-   MPlug             plugWeight = plugArrWeight.elementByLogicalIndex(idx);
+   MObject           oAlias;
+   MFnDependencyNode fnDeformer(plugWeight.node());
+
+   modifier.newPlugValueFloat(plugWeight, 0.0f);
+   if(!fnDeformer.findAlias(name, oAlias))
+      modifier.commandToExecute("aliasAttr " + name + " " + plugWeight.name());
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method queues the name of a target.
+//
+void MorpheCmd::SetTargetName(MDGModifier &modifier, const MPlug &plugItem, const MString &name)
+{
+   modifier.newPlugValueString(plugItem.child(MorpheNode::aMorpheName), name);
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method queues the IDs of weights involved for a specific target.
+//
+void MorpheCmd::SetTargetWeight(MDGModifier &modifier, const MPlug &plugItem, const MIntArray &idxWeight)
+{
+   MFnIntArrayData   fnWt;
+   MObject           oWt = fnWt.create(idxWeight);
+   modifier.newPlugValue(plugItem.child(MorpheNode::aMorpheWeights), oWt);
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method queues the connection of a target mesh to the deformer.
+//
+void MorpheCmd::ConnectInputs(MDGModifier &modifier, const MDagPath &dpTarget, const MPlug &plugItem)
+{
+   MFnDependencyNode fnObj(dpTarget.node());
+   MPlug             plugArrWorldMesh = fnObj.findPlug("worldMesh");
+   MPlug             plugWorldMesh    = plugArrWorldMesh.elementByLogicalIndex(0); // First instance is requested for mesh shapes.
 
-   plugWeight.setValue(0.0);
-   fnDeformer.setAlias(fnObj.name(), plugWeight.partialName(false, false, false, false, false, true), plugWeight);
+   modifier.connect(plugWorldMesh, plugItem.child(MorpheNode::aMorpheGeometry));
 }
 // -----------------------------------------------------------------------------
 
 
 //
 // Description:
-//    This method sets the name for the target.
+//    This method queues the connection of the scene time to the deformer
+//      time, which the streaming look-ahead starts from, unless the time
+//      already has an input.
 //
-void MorpheCmd::SetTargetName(MObject &objDeformer, unsigned int &idxTarget, MString &name)
+void MorpheCmd::ConnectTime(MDGModifier &modifier, const MObject &objDeformer)
+{
+   MPlug       plugTime(objDeformer, MorpheNode::aTime);
+   MPlugArray  sources;
+   if(plugTime.connectedTo(sources, true, false) && sources.length() > 0)
+      return;
+
+   MItDependencyNodes itTime(MFn::kTime);
+   if(!itTime.isDone())
+      modifier.connect(MFnDependencyNode(itTime.thisNode()).findPlug("outTime"), plugTime);
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method queues a new item and weight per target mesh, after the
+//      last existing ones of the deformer. Nothing is changed until the
+//      modifier is executed, so any number of targets costs one doIt and
+//      one undo step.
+//
+// Return Values:
+//    MS::kSuccess
+//    MS::kFailure
+//
+MStatus MorpheCmd::AddTargets(MDGModifier &modifier, const MObject &objDeformer, MSelectionList &targets, unsigned int &uAdded)
 {
    MFnDependencyNode fnDeformer(objDeformer);
+   MPlug             plugArrWeight(fnDeformer.findPlug(MorpheNode::aWeight));
    MPlug             plugArrItem(fnDeformer.findPlug(MorpheNode::aMorpheItem));
-   MPlug             plugItem = plugArrItem.elementByLogicalIndex(idxTarget);
-   MPlug             plugName  = plugItem.child(MorpheNode::aMorpheName);
-
-   plugName.setValue(name);
-   
-   // DEBUG: Delete in the future.
-   MGlobal::displayInfo(name);
-   // DEBUG: Delete in the future.
+
+   uAdded = 0;
+
+   // New logical indices follow the existing ones
+   MIntArray         existing;
+   unsigned int      uWeightIdx = 0, uItemIdx = 0;
+   plugArrWeight.getExistingArrayAttributeIndices(existing);
+   for(unsigned int i = 0; i < existing.length(); i++)
+   {
+      if((unsigned int)existing[i] + 1 > uWeightIdx)
+         uWeightIdx = existing[i] + 1;
+   }
+   plugArrItem.getExistingArrayAttributeIndices(existing);
+   for(unsigned int i = 0; i < existing.length(); i++)
+   {
+      if((unsigned int)existing[i] + 1 > uItemIdx)
+         uItemIdx = existing[i] + 1;
+   }
+
+   for(unsigned int i = 0; i < targets.length(); i++)
+   {
+      MDagPath          dpTarget;
+      if(targets.getDagPath(i, dpTarget) != MS::kSuccess)
+         continue;
+
+      MFnDependencyNode fnObj(dpTarget.node());
+      MString           name = fnObj.name();
+      dpTarget.extendToShape();
+      if(!dpTarget.hasFn(MFn::kMesh))
+      {
+         MGlobal::displayError(name + " is not a mesh.");
+         return MS::kFailure;
+      }
+
+      MPlug          plugItem = plugArrItem.elementByLogicalIndex(uItemIdx);
+      MIntArray      uArrWt;
+      uArrWt.append(uWeightIdx);
+
+      AddWeight(modifier, plugArrWeight.elementByLogicalIndex(uWeightIdx), name);
+      ConnectInputs(modifier, dpTarget, plugItem);
+      SetTargetName(modifier, plugItem, name);
+      SetTargetWeight(modifier, plugItem, uArrWt);
+
+      uWeightIdx++;
+      uItemIdx++;
+      uAdded++;
+   }
+   return MS::kSuccess;
 }
 // -----------------------------------------------------------------------------
 
 
 //
 // Description:
-//    This method sets the IDs of weights involved for a specific target.
+//    This method lists every morphe node of the scene.
 //
-void MorpheCmd::SetTargetWeight(MObject &objDeformer, unsigned int &idxTarget, MIntArray &idxWeight)
+void MorpheCmd::GetMorpheNodes(MObjectArray &nodes)
 {
+   nodes.clear();
+   for(MItDependencyNodes itNode(MFn::kPluginDeformerNode); !itNode.isDone(); itNode.next())
+   {
+      MObject oNode = itNode.thisNode();
+      if(MFnDependencyNode(oNode).typeId() == MorpheNode::id)
+         nodes.append(oNode);
+   }
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method finds a morphe deformer node by name.
+//
+// Return Values:
+//    MS::kSuccess
+//    MS::kFailure
+//
+MStatus MorpheCmd::GetMorpheNode(const MString &name, MObject &objDeformer)
+{
+   MSelectionList list;
+   if(list.add(name) != MS::kSuccess)
+   {
+      MGlobal::displayError(name + " does not exist.");
+      return MS::kFailure;
+   }
+
+   list.getDependNode(0, objDeformer);
    MFnDependencyNode fnDeformer(objDeformer);
-   MPlug             plugArrItem(fnDeformer.findPlug(MorpheNode::aMorpheItem));
-   MPlug             plugItem = plugArrItem.elementByLogicalIndex(idxTarget);
-   MPlug             plugWt   = plugItem.child(MorpheNode::aMorpheWeights);
+   if(fnDeformer.typeId() != MorpheNode::id)
+   {
+      MGlobal::displayError(name + " is not a morphe node.");
+      return MS::kFailure;
+   }
+   return MS::kSuccess;
+}
+// -----------------------------------------------------------------------------
 
-   MFnIntArrayData   fnWt;
-   MObject           oWt = fnWt.create(idxWeight);
-   plugWt.setValue(oWt);
-   
-   // DEBUG: Delete in the future.
-   //MFnIntArrayData   test(plugWt.asMObject());
-   //MString tmpStr("Weight: ");
-   //tmpStr = tmpStr + test[0];
-   //MGlobal::displayInfo(tmpStr);
-   // DEBUG: Delete in the future.
+
+//
+// Description:
+//    This method builds a target from the mesh connected to plugGeo, or else
+//      from the baked points and components. plugSrc is set to the mesh
+//      source plug when the target is live.
+//
+// Return Values:
+//    true if there was a target
+//
+bool MorpheCmd::GetPlugTarget(const MPlug &plugGeo, const MPlug &plugPoints, const MPlug &plugComponents, const std::vector<float> &baseXYZ, MorpheTarget &target, MPlug &plugSrc)
+{
+   std::vector<float>   targetXYZ;
+   std::vector<int>     bakedComponents;
+   unsigned int         uVertexCount = (unsigned int)baseXYZ.size() / 3;
+   MPlugArray           connected;
+
+   plugSrc = MPlug();
+   if(plugGeo.connectedTo(connected, true, false) && connected.length() > 0)
+   {
+      MObject     oTarget;
+      plugGeo.getValue(oTarget);
+      unsigned int uTargetCount = MorpheNode::GetMeshPoints(oTarget, targetXYZ);
+      if(uTargetCount == 0)
+         return false;
+
+      target.Build(&targetXYZ[0], &baseXYZ[0], uTargetCount, uVertexCount, MORPHE_ZERO_THRESHOLD);
+      plugSrc = connected[0];
+      return true;
+   }
+
+   if(MorpheNode::GetBakedTarget(plugPoints.asMObject(), plugComponents.asMObject(), bakedComponents, targetXYZ))
+   {
+      target.Build(&bakedComponents[0], &targetXYZ[0], (unsigned int)bakedComponents.size(), uVertexCount);
+      return true;
+   }
+
+   return false;
 }
 // -----------------------------------------------------------------------------
 
 
 //
 // Description:
-//    This method connect a target mesh to the deformer.
+//    This method stores the sparse deltas of a target and the matching
+//      vertex component list.
 //
-void MorpheCmd::ConnectInputs(MObject &obj, MObject &objDeformer, unsigned int &idx)
+void MorpheCmd::SetBakedTarget(const MorpheTarget &target, MPlug plugPoints, MPlug plugComponents)
+{
+   MPointArray    points;
+   MIntArray      elements;
+   for(unsigned int k = 0; k < target.Count(); k++)
+   {
+      elements.append((int)target.Index(k));
+      points.append(MPoint(target.dx[k], target.dy[k], target.dz[k]));
+   }
+
+   MFnSingleIndexedComponent fnComp;
+   MObject        oComp = fnComp.create(MFn::kMeshVertComponent);
+   fnComp.addElements(elements);
+
+   MFnComponentListData fnComponents;
+   MObject        oComponents = fnComponents.create();
+   fnComponents.add(oComp);
+
+   MFnPointArrayData fnPoints;
+   MObject        oPoints = fnPoints.create(points);
+
+   plugPoints.setValue(oPoints);
+   plugComponents.setValue(oComponents);
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method empties baked points and components.
+//
+void MorpheCmd::ClearBakedTarget(MPlug plugPoints, MPlug plugComponents)
+{
+   MFnPointArrayData fnPoints;
+   MObject        oPoints = fnPoints.create(MPointArray());
+
+   MFnComponentListData fnComponents;
+   MObject        oComponents = fnComponents.create();
+
+   plugPoints.setValue(oPoints);
+   plugComponents.setValue(oComponents);
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method captures every connected target into the morphePoints and
+//      morpheComponents attributes of its item, as sparse deltas against the
+//      deformer input geometry, and disconnects the target mesh. The target
+//      meshes can be deleted afterwards. Combination items are stored
+//      relative to their painted parents, the way MorpheNode evaluates
+//      them; painted weights stay separate.
+//
+// Return Values:
+//    MS::kSuccess
+//    MS::kFailure
+//
+MStatus MorpheCmd::BakeTargets(MObject &objDeformer, unsigned int &uBaked)
 {
    MDGModifier       modifier;
-   MFnDagNode        dagObj(obj);
-   MDagPath          shapeObj; dagObj.getPath(shapeObj); shapeObj.extendToShape();
-   MFnDependencyNode fnObj(shapeObj.node());
-   MPlug             plugArrWorldMesh = fnObj.findPlug("worldMesh");
-   MPlug             plugWorldMesh    = plugArrWorldMesh.elementByLogicalIndex(0); // First instance is requested for mesh shapes.
+   MFnDependencyNode fnDeformer(objDeformer);
+
+   uBaked = 0;
+
+   // Base points the deltas are relative to
+   MObject           oBase;
+   std::vector<float> baseXYZ;
+   MPlug             plugArrInput(fnDeformer.findPlug(MorpheNode::input));
+   MPlug             plugBase = plugArrInput.elementByLogicalIndex(0).child(MorpheNode::inputGeom);
+   plugBase.getValue(oBase);
+   if(oBase.isNull())
+   {
+      MGlobal::displayError(fnDeformer.name() + " has no input geometry to bake against.");
+      return MS::kFailure;
+   }
+   if(MorpheNode::GetMeshPoints(oBase, baseXYZ) == 0)
+      return MS::kFailure;
+
+   // Gather every item with a target, live or already baked, and its in-betweens
+   MPlug                         plugArrItem(fnDeformer.findPlug(MorpheNode::aMorpheItem));
+   unsigned int                  uItemCount = plugArrItem.numElements();
+   std::vector<MorpheItem>       items(uItemCount);
+   std::vector<MPlug>            srcPlugs(uItemCount);
+   std::vector< std::vector<MPlug> > inbetweenPlugs(uItemCount);
+   std::vector< std::vector<MPlug> > inbetweenSrcPlugs(uItemCount);
+   std::vector< std::pair<unsigned int, unsigned int> > order;   // (weight count, physical index)
+   for(unsigned int i = 0; i < uItemCount; i++)
+   {
+      MPlug          plugItem = plugArrItem.elementByPhysicalIndex(i);
+
+      MFnIntArrayData fnIds(plugItem.child(MorpheNode::aMorpheWeights).asMObject());
+      MIntArray      ids = fnIds.array();
+      if(ids.length() > 0)
+         items[i].SetWeightIds(&ids[0], ids.length());
+
+      if(!GetPlugTarget(plugItem.child(MorpheNode::aMorpheGeometry), plugItem.child(MorpheNode::aMorphePoints),
+                        plugItem.child(MorpheNode::aMorpheComponents), baseXYZ, items[i].target, srcPlugs[i]))
+         continue;
+
+      // In-betweens keep their plug order, segments are only needed by the node
+      MPlug          plugArrInbetween = plugItem.child(MorpheNode::aMorpheInbetween);
+      unsigned int   uInbetweenCount = plugArrInbetween.numElements();
+      for(unsigned int k = 0; k < uInbetweenCount; k++)
+      {
+         MPlug          plugInbetween = plugArrInbetween.elementByPhysicalIndex(k);
+         MorpheTarget   inbetween;
+         MPlug          plugSrc;
+         if(!GetPlugTarget(plugInbetween.child(MorpheNode::aMorpheInbetweenGeometry), plugInbetween.child(MorpheNode::aMorpheInbetweenPoints),
+                           plugInbetween.child(MorpheNode::aMorpheInbetweenComponents), baseXYZ, inbetween, plugSrc))
+            continue;
+         items[i].AddInbetween(plugInbetween.child(MorpheNode::aMorpheInbetweenWeight).asFloat()) = inbetween;
+         inbetweenPlugs[i].push_back(plugInbetween);
+         inbetweenSrcPlugs[i].push_back(plugSrc);
+      }
+      order.push_back(std::make_pair((unsigned int)items[i].weightIds.size(), i));
+   }
 
+   // Parents are made relative before the combinations using them
+   std::sort(order.begin(), order.end());
+
+   // Parents contribute with their painted weights applied
+   std::vector<MorpheItem>       painted(uItemCount);
+   std::vector<const MorpheItem*> parents;
+   for(unsigned int i = 0; i < uItemCount; i++)
+      parents.push_back(&painted[i]);
+
+   std::vector<unsigned int>     maskIndices;
+   std::vector<float>            maskValues;
+   for(size_t o = 0; o < order.size(); o++)
+   {
+      unsigned int   i = order[o].second;
+      MPlug          plugItem = plugArrItem.elementByPhysicalIndex(i);
+      bool           bLive = !srcPlugs[i].isNull();
+      bool           bBaked = false;
+
+      // Like the node, only items with a live target are made relative
+      if(bLive)
+         items[i].MakeCorrective(parents, MORPHE_ZERO_THRESHOLD);
+
+      // Sorting the copy keeps the in-betweens of items[i] in plug order
+      painted[i] = items[i];
+      painted[i].BuildSegments();
+      MorpheNode::GetTargetWeights(plugItem, maskIndices, maskValues);
+      if(!maskIndices.empty())
+         painted[i].ApplyWeights(&maskIndices[0], &maskValues[0], (unsigned int)maskIndices.size(), MORPHE_ZERO_THRESHOLD);
+
+      if(bLive)
+      {
+         SetBakedTarget(items[i].target, plugItem.child(MorpheNode::aMorphePoints), plugItem.child(MorpheNode::aMorpheComponents));
+         modifier.disconnect(srcPlugs[i], plugItem.child(MorpheNode::aMorpheGeometry));
+         bBaked = true;
+      }
+
+      for(size_t k = 0; k < inbetweenPlugs[i].size(); k++)
+      {
+         MPlug       &plugInbetween = inbetweenPlugs[i][k];
+         bool        bInbetweenLive = !inbetweenSrcPlugs[i][k].isNull();
+         if(!bLive && !bInbetweenLive)
+            continue;
+
+         SetBakedTarget(items[i].inbetweens[k], plugInbetween.child(MorpheNode::aMorpheInbetweenPoints), plugInbetween.child(MorpheNode::aMorpheInbetweenComponents));
+         if(bInbetweenLive)
+            modifier.disconnect(inbetweenSrcPlugs[i][k], plugInbetween.child(MorpheNode::aMorpheInbetweenGeometry));
+         bBaked = true;
+      }
+
+      if(bBaked)
+         uBaked++;
+   }
+
+   return modifier.doIt();
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method writes every item of a morphe node to a target library and
+//      makes the node read them from it. Live targets are baked first, then
+//      the baked points and components are emptied so the scene no longer
+//      stores or loads any target. Items only found in the current library
+//      are carried over.
+//
+// Return Values:
+//    MS::kSuccess
+//    MS::kFailure
+//
+MStatus MorpheCmd::ExportLibrary(MObject &objDeformer, const MString &sPath, unsigned int &uExported)
+{
+   MStatus           status;
    MFnDependencyNode fnDeformer(objDeformer);
+   MPlug             plugLibrary(fnDeformer.findPlug(MorpheNode::aLibraryPath));
    MPlug             plugArrItem(fnDeformer.findPlug(MorpheNode::aMorpheItem));
-   MPlug             plugItem = plugArrItem.elementByLogicalIndex(idx);
-   MPlug             plugGeo  = plugItem.child(MorpheNode::aMorpheGeometry);
 
-   modifier.connect(plugWorldMesh, plugGeo);
-   modifier.doIt();
+   uExported = 0;
+
+   unsigned int uBaked = 0;
+   status = BakeTargets(objDeformer, uBaked);
+   if(status != MS::kSuccess)
+      return status;
+
+   // Vertex count the baked deltas refer to
+   MObject           oBase;
+   MPlug             plugArrInput(fnDeformer.findPlug(MorpheNode::input));
+   plugArrInput.elementByLogicalIndex(0).child(MorpheNode::inputGeom).getValue(oBase);
+   unsigned int      uVertexCount = oBase.isNull() ? 0 : (unsigned int)MFnMesh(oBase).numVertices();
+
+   MorpheLibrary     current;
+   MString           sCurrent = plugLibrary.asString();
+   if(sCurrent.length() > 0)
+      current.Open(sCurrent.asChar());
+
+   // Items from the baked data, else from the current library
+   unsigned int                     uItemCount = plugArrItem.numElements();
+   std::vector<MorpheItem>          items(uItemCount);
+   std::vector<MorpheLibraryEntry>  entries;
+   std::vector<int>                 bakedComponents;
+   std::vector<float>               bakedDeltas;
+   for(unsigned int i = 0; i < uItemCount; i++)
+   {
+      MPlug          plugItem = plugArrItem.elementByPhysicalIndex(i);
+      unsigned int   uItemIdx = plugItem.logicalIndex();
+      MorpheItem     &item = items[i];
+
+      if(MorpheNode::GetBakedTarget(plugItem.child(MorpheNode::aMorphePoints).asMObject(),
+                                    plugItem.child(MorpheNode::aMorpheComponents).asMObject(), bakedComponents, bakedDeltas))
+      {
+         item.target.Build(&bakedComponents[0], &bakedDeltas[0], (unsigned int)bakedComponents.size(), uVertexCount);
+
+         MPlug          plugArrInbetween = plugItem.child(MorpheNode::aMorpheInbetween);
+         unsigned int   uInbetweenCount = plugArrInbetween.numElements();
+         for(unsigned int k = 0; k < uInbetweenCount; k++)
+         {
+            MPlug plugInbetween = plugArrInbetween.elementByPhysicalIndex(k);
+            if(MorpheNode::GetBakedTarget(plugInbetween.child(MorpheNode::aMorpheInbetweenPoints).asMObject(),
+                                          plugInbetween.child(MorpheNode::aMorpheInbetweenComponents).asMObject(), bakedComponents, bakedDeltas))
+            {
+               item.AddInbetween(plugInbetween.child(MorpheNode::aMorpheInbetweenWeight).asFloat())
+                  .Build(&bakedComponents[0], &bakedDeltas[0], (unsigned int)bakedComponents.size(), uVertexCount);
+            }
+         }
+         item.BuildSegments();
+      }
+      else
+      {
+         int iRecord = current.Find(uItemIdx);
+         if(iRecord < 0 || current.VertexCount() != uVertexCount || !current.Load((unsigned int)iRecord, item))
+            continue;
+      }
+
+      MFnIntArrayData fnIds(plugItem.child(MorpheNode::aMorpheWeights).asMObject());
+      MIntArray      ids = fnIds.array();
+      if(ids.length() > 0)
+         item.SetWeightIds(&ids[0], ids.length());
+
+      MorpheLibraryEntry entry;
+      entry.index = uItemIdx;
+      entry.name  = plugItem.child(MorpheNode::aMorpheName).asString().asChar();
+      entry.item  = &item;
+      entries.push_back(entry);
+   }
+   current.Close();
+
+   // The node releases its mapping before the file is replaced
+   plugLibrary.setValue(MString(""));
+   if(!MorpheWriteLibrary(sPath.asChar(), uVertexCount, entries))
+   {
+      MGlobal::displayError("Cannot write " + sPath);
+      plugLibrary.setValue(sCurrent);
+      return MS::kFailure;
+   }
+
+   // Targets now come from the library only
+   for(unsigned int i = 0; i < uItemCount; i++)
+   {
+      MPlug          plugItem = plugArrItem.elementByPhysicalIndex(i);
+      MPlug          plugArrInbetween = plugItem.child(MorpheNode::aMorpheInbetween);
+      ClearBakedTarget(plugItem.child(MorpheNode::aMorphePoints), plugItem.child(MorpheNode::aMorpheComponents));
+      for(unsigned int k = 0; k < plugArrInbetween.numElements(); k++)
+      {
+         MPlug plugInbetween = plugArrInbetween.elementByPhysicalIndex(k);
+         ClearBakedTarget(plugInbetween.child(MorpheNode::aMorpheInbetweenPoints), plugInbetween.child(MorpheNode::aMorpheInbetweenComponents));
+      }
+   }
+   plugLibrary.setValue(sPath);
+
+   uExported = (unsigned int)entries.size();
+   return MS::kSuccess;
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method bakes the deformed first geometry of a morphe node from
+//      dStart to dEnd, one frame per unit, into a point cache file. Weights,
+//      envelope and input geometry are sampled per frame; the deltas of
+//      MORPHE_FRAME_BLOCK frames are evaluated together by the node and
+//      streamed out, so targets are fetched once per block instead of once
+//      per frame.
+//
+// Return Values:
+//    MS::kSuccess
+//    MS::kFailure
+//
+MStatus MorpheCmd::BakeFrames(MObject &objDeformer, double dStart, double dEnd, const MString &sPath, unsigned int &uFrames)
+{
+   MStatus           status;
+   MFnDependencyNode fnDeformer(objDeformer);
+   MorpheNode        *pMorphe = (MorpheNode*)fnDeformer.userNode();
+   MPlug             plugArrWeight(fnDeformer.findPlug(MorpheNode::aWeight));
+   MPlug             plugEnvelope(fnDeformer.findPlug(MorpheNode::envelope));
+   MPlug             plugArrInput(fnDeformer.findPlug(MorpheNode::input));
+   MPlug             plugBase = plugArrInput.elementByLogicalIndex(0).child(MorpheNode::inputGeom);
+
+   uFrames = 0;
+   if(dEnd < dStart)
+   {
+      MGlobal::displayError("-bf/bakeFrames end frame is before its start frame.");
+      return MS::kFailure;
+   }
+
+   // Weights are sampled by logical index
+   MIntArray         weightIds;
+   unsigned int      uWeightCount = 0;
+   plugArrWeight.getExistingArrayAttributeIndices(weightIds);
+   for(unsigned int i = 0; i < weightIds.length(); i++)
+   {
+      if((unsigned int)weightIds[i] + 1 > uWeightCount)
+         uWeightCount = weightIds[i] + 1;
+   }
+
+   MorphePointCacheWriter              writer;
+   MorpheWeightMap                     weightMap;
+   std::vector< std::vector<float> >   frameWeights;
+   std::vector< std::vector<float> >   frameBases;
+   std::vector<float>                  frameEnvelopes;
+   std::vector<MorpheDeltas>           frameDeltas;
+   std::vector<float>                  px, py, pz;
+
+   unsigned int uFrameCount = (unsigned int)(dEnd - dStart) + 1;
+   for(unsigned int uFirst = 0; uFirst < uFrameCount; uFirst += MORPHE_FRAME_BLOCK)
+   {
+      unsigned int uBlock = uFrameCount - uFirst < MORPHE_FRAME_BLOCK ? uFrameCount - uFirst : MORPHE_FRAME_BLOCK;
+      frameWeights.assign(uBlock, std::vector<float>(uWeightCount, 0.0f));
+      frameEnvelopes.assign(uBlock, 0.0f);
+      frameBases.resize(uBlock);
+
+      // Sample every frame of the block
+      for(unsigned int f = 0; f < uBlock; f++)
+      {
+         MDGContext  ctx(MTime(dStart + uFirst + f, MTime::uiUnit()));
+         for(unsigned int i = 0; i < weightIds.length(); i++)
+            plugArrWeight.elementByLogicalIndex(weightIds[i]).getValue(frameWeights[f][weightIds[i]], ctx);
+         plugEnvelope.getValue(frameEnvelopes[f], ctx);
+
+         MObject     oBase;
+         plugBase.getValue(oBase, ctx);
+         MorpheNode::GetMeshPoints(oBase, frameBases[f]);
+      }
+
+      status = pMorphe->EvaluateFrames(frameWeights, frameEnvelopes, frameDeltas, weightMap);
+      if(status != MS::kSuccess)
+         return status;
+
+      // Deformed points, only the painted ones move as in deform
+      for(unsigned int f = 0; f < uBlock; f++)
+      {
+         const MorpheDeltas &deltas = frameDeltas[f];
+         unsigned int uCount = deltas.Count();
+         if(uCount == 0 || frameBases[f].size() != uCount * 3 || weightMap.Count() != uCount)
+         {
+            MGlobal::displayError(fnDeformer.name() + " input geometry changes topology during the bake.");
+            return MS::kFailure;
+         }
+
+         if(!writer.IsOpen() && !writer.Open(sPath.asChar(), uCount, (float)dStart, 1.0f))
+         {
+            MGlobal::displayError("Cannot write " + sPath);
+            return MS::kFailure;
+         }
+
+         px.resize(uCount);
+         py.resize(uCount);
+         pz.resize(uCount);
+         for(unsigned int j = 0; j < uCount; j++)
+         {
+            px[j] = frameBases[f][3*j];
+            py[j] = frameBases[f][3*j+1];
+            pz[j] = frameBases[f][3*j+2];
+         }
+         for(size_t k = 0; k < weightMap.indices.size(); k++)
+         {
+            unsigned int j  = weightMap.indices[k];
+            float        wt = weightMap.values[j];
+            px[j] += deltas.x[j] * wt;
+            py[j] += deltas.y[j] * wt;
+            pz[j] += deltas.z[j] * wt;
+         }
+
+         if(!writer.WriteFrame(&px[0], &py[0], &pz[0]))
+         {
+            MGlobal::displayError("Cannot write " + sPath);
+            return MS::kFailure;
+         }
+         uFrames++;
+      }
+   }
+
+   if(!writer.Close())
+   {
+      MGlobal::displayError("Cannot write " + sPath);
+      return MS::kFailure;
+   }
+   return MS::kSuccess;
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    Constructor.
+//
+MorpheCmd::MorpheCmd()
+   : mUndoable(false)
+{
 }
 // -----------------------------------------------------------------------------
 
@@ -124,10 +706,23 @@ MSyntax MorpheCmd::newSyntax()
    MSyntax syntax;
 
    // Query Mode
+   syntax.addFlag(kCacheStatsFlag, kCacheStatsFlagLong);
+   syntax.addFlag(kResultCacheStatsFlag, kResultCacheStatsFlagLong);
+   syntax.addFlag(kQuantizeErrorFlag, kQuantizeErrorFlagLong);
+   syntax.addFlag(kBasisErrorFlag, kBasisErrorFlagLong);
+   syntax.addFlag(kStatsFlag, kStatsFlagLong);
+   syntax.addFlag(kResetStatsFlag, kResetStatsFlagLong);
 
    // Edit Mode
    syntax.addFlag(kCreateMorphesFlag, kCreateMorphesFlagLong, MSyntax::kString);
-   //syntax.makeFlagMultiUse(kCreateMorphesFlag);
+   syntax.addFlag(kBakeFlag, kBakeFlagLong);
+   syntax.addFlag(kBakeFramesFlag, kBakeFramesFlagLong, MSyntax::kDouble, MSyntax::kDouble);
+   syntax.addFlag(kFileFlag, kFileFlagLong, MSyntax::kString);
+   syntax.addFlag(kExportLibraryFlag, kExportLibraryFlagLong, MSyntax::kString);
+   syntax.makeFlagMultiUse(kCreateMorphesFlag);
+
+   // Morphe node to query or edit
+   syntax.setObjectType(MSyntax::kStringObjects, 0, 1);
 
    // Enable Query and Edit
    syntax.enableQuery(true);
@@ -151,27 +746,21 @@ MStatus MorpheCmd::parseArgs(const MArgList &args)
 
    MArgDatabase argData(syntax(), args, &status);
 
-   // -createMorphes [objectList]
+   // -createMorphes object [-createMorphes object ...]
+   mCreateMorphes.clear();
    if(argData.isFlagSet(kCreateMorphesFlag) && argData.isEdit())
    {
-      // status = argData.getFlagArgument(kCreateMorphesFlag, 0, sCreateMorphes);
-      unsigned int uCmsPos = 0;
-      argData.getFlagArgumentPosition(kCreateMorphesFlag, 0, uCmsPos);
-      unsigned int uCmsArgPos = uCmsPos + 1;
-      sCreateMorphes = args.asStringArray(uCmsArgPos, &status);
-      if(status != MS::kSuccess)
-      {
-         MGlobal::displayError("-cms/createMorphes is missing a list of objects argument");
-         return status;
-      }
-      else
+      unsigned int uUses = argData.numberOfFlagUses(kCreateMorphesFlag);
+      for(unsigned int i = 0; i < uUses; i++)
       {
-         unsigned int i = 2;
-         //MGlobal::displayInfo(kk.asString());
-         MString tmpStr("Weight: ");
-         tmpStr = tmpStr + sCreateMorphes.length();
-         tmpStr = tmpStr + "     Position: " + uCmsPos;
-         MGlobal::displayInfo(tmpStr);
+         MArgList argTarget;
+         argData.getFlagArgumentList(kCreateMorphesFlag, i, argTarget);
+         MString  sTarget = argTarget.asString(0);
+         if(mCreateMorphes.add(sTarget) != MS::kSuccess)
+         {
+            MGlobal::displayError(sTarget + " does not exist.");
+            return MS::kFailure;
+         }
       }
    }
    return MS::kSuccess;
@@ -200,21 +789,246 @@ MStatus MorpheCmd::doIt (const MArgList &args)
    // Query Mode
    if(argData.isQuery())
    {
-      MGlobal::displayInfo("query mode");
+      MStringArray   objects;
+      MObject        objDeformer;
+      argData.getObjects(objects);
+      if(objects.length() == 0)
+      {
+         MGlobal::displayError("Specify a morphe node to query.");
+         return MS::kFailure;
+      }
+      if(GetMorpheNode(objects[0], objDeformer) != MS::kSuccess)
+         return MS::kFailure;
+
+      MorpheNode *pMorphe = (MorpheNode*)MFnDependencyNode(objDeformer).userNode();
+
+      // -cacheStats : [hits, misses]
+      if(argData.isFlagSet(kCacheStatsFlag))
+      {
+         unsigned int uHits, uMisses;
+         pMorphe->GetCacheStats(uHits, uMisses);
+
+         MIntArray result;
+         result.append((int)uHits);
+         result.append((int)uMisses);
+         clearResult();
+         setResult(result);
+      }
+
+      // -resultCacheStats : [hits, misses, results, megabytes]
+      if(argData.isFlagSet(kResultCacheStatsFlag))
+      {
+         unsigned int   uHits, uMisses, uCount;
+         size_t         uSize;
+         pMorphe->GetResultCacheStats(uHits, uMisses, uCount, uSize);
+
+         MDoubleArray result;
+         result.append(uHits);
+         result.append(uMisses);
+         result.append(uCount);
+         result.append(uSize / 1048576.0);
+         clearResult();
+         setResult(result);
+      }
+
+      // -stats : "name=value" evaluation counters, times in milliseconds
+      if(argData.isFlagSet(kStatsFlag))
+      {
+         MorpheStats    stats;
+         unsigned int   uHits, uMisses;
+         pMorphe->GetStats(stats);
+         pMorphe->GetCacheStats(uHits, uMisses);
+
+         double dTotal = stats.gatherTime + stats.fetchTime + stats.accumulateTime + stats.writeTime;
+         MStringArray result;
+         result.append(MString("evaluations=") + stats.evaluations);
+         result.append(MString("totalMs=") + dTotal * 1000.0);
+         result.append(MString("averageMs=") + (stats.evaluations > 0 ? dTotal * 1000.0 / stats.evaluations : 0.0));
+         result.append(MString("gatherMs=") + stats.gatherTime * 1000.0);
+         result.append(MString("fetchMs=") + stats.fetchTime * 1000.0);
+         result.append(MString("accumulateMs=") + stats.accumulateTime * 1000.0);
+         result.append(MString("writeMs=") + stats.writeTime * 1000.0);
+         result.append(MString("activeItems=") + stats.activeItems);
+         result.append(MString("terms=") + stats.terms);
+         result.append(MString("verticesTouched=") + stats.verticesTouched);
+         result.append(MString("cacheHits=") + uHits);
+         result.append(MString("cacheMisses=") + uMisses);
+
+         unsigned int   uResultHits, uResultMisses, uResultCount;
+         size_t         uResultSize;
+         pMorphe->GetResultCacheStats(uResultHits, uResultMisses, uResultCount, uResultSize);
+         result.append(MString("resultCacheHits=") + uResultHits);
+         result.append(MString("resultCacheMisses=") + uResultMisses);
+         result.append(MString("resultCacheHitRate=") + (uResultHits + uResultMisses > 0 ? (double)uResultHits / (uResultHits + uResultMisses) : 0.0));
+         result.append(MString("resultCacheResults=") + uResultCount);
+         result.append(MString("resultCacheMB=") + uResultSize / 1048576.0);
+
+         unsigned int   uStreamResident, uStreamLoads, uStreamPrefetches, uStreamEvictions;
+         size_t         uStreamSize;
+         pMorphe->GetStreamStats(uStreamResident, uStreamSize, uStreamLoads, uStreamPrefetches, uStreamEvictions);
+         result.append(MString("streamResident=") + uStreamResident);
+         result.append(MString("streamMB=") + uStreamSize / 1048576.0);
+         result.append(MString("streamLoads=") + uStreamLoads);
+         result.append(MString("streamPrefetches=") + uStreamPrefetches);
+         result.append(MString("streamEvictions=") + uStreamEvictions);
+
+         std::vector<float>   basisErrors;
+         unsigned int         uShapeCount = 0;
+         if(pMorphe->GetBasisErrors(basisErrors, uShapeCount))
+         {
+            result.append(MString("basisShapes=") + uShapeCount);
+            result.append(MString("basisError=") + basisErrors[uShapeCount]);
+         }
+         clearResult();
+         setResult(result);
+      }
+
+      // -quantizeError : largest delta error of the quantized targets
+      if(argData.isFlagSet(kQuantizeErrorFlag))
+      {
+         clearResult();
+         setResult((double)pMorphe->GetQuantizeError());
+      }
+
+      // -basisError : basis error for every shape count, from 0 shapes
+      if(argData.isFlagSet(kBasisErrorFlag))
+      {
+         std::vector<float>   errors;
+         unsigned int         uShapeCount;
+         pMorphe->GetBasisErrors(errors, uShapeCount);
+
+         MDoubleArray result;
+         for(size_t k = 0; k < errors.size(); k++)
+            result.append(errors[k]);
+         clearResult();
+         setResult(result);
+      }
    }
 
    // Edit Mode
    if(argData.isEdit())
    {
-      MGlobal::displayInfo("edit mode");
+      MStringArray   objects;
+      MObject        objDeformer;
+      argData.getObjects(objects);
+
+      // -resetStats : clear the evaluation and cache counters
+      if(argData.isFlagSet(kResetStatsFlag))
+      {
+         if(objects.length() == 0)
+         {
+            MGlobal::displayError("Specify a morphe node to reset.");
+            return MS::kFailure;
+         }
+         if(GetMorpheNode(objects[0], objDeformer) != MS::kSuccess)
+            return MS::kFailure;
+
+         ((MorpheNode*)MFnDependencyNode(objDeformer).userNode())->ResetStats();
+      }
+
+      // -createMorphes object ... : add targets after the existing ones
+      if(argData.isFlagSet(kCreateMorphesFlag))
+      {
+         if(objects.length() == 0)
+         {
+            MGlobal::displayError("Specify a morphe node to add targets to.");
+            return MS::kFailure;
+         }
+         if(GetMorpheNode(objects[0], objDeformer) != MS::kSuccess)
+            return MS::kFailure;
+
+         unsigned int uAdded = 0;
+         status = AddTargets(mModifier, objDeformer, mCreateMorphes, uAdded);
+         if(status != MS::kSuccess)
+            return status;
+         ConnectTime(mModifier, objDeformer);
+         status = mModifier.doIt();
+         if(status != MS::kSuccess)
+         {
+            mModifier.undoIt();
+            return status;
+         }
+         mUndoable = true;
+
+         clearResult();
+         setResult((int)uAdded);
+      }
+
+      // -bake : store targets in the node and detach the meshes
+      if(argData.isFlagSet(kBakeFlag))
+      {
+         if(objects.length() == 0)
+         {
+            MGlobal::displayError("Specify a morphe node to bake.");
+            return MS::kFailure;
+         }
+         if(GetMorpheNode(objects[0], objDeformer) != MS::kSuccess)
+            return MS::kFailure;
+
+         unsigned int uBaked = 0;
+         status = BakeTargets(objDeformer, uBaked);
+         if(status != MS::kSuccess)
+            return status;
+
+         clearResult();
+         setResult((int)uBaked);
+      }
+
+      // -exportLibrary path : move every target to a library file
+      if(argData.isFlagSet(kExportLibraryFlag))
+      {
+         MString  sPath;
+         argData.getFlagArgument(kExportLibraryFlag, 0, sPath);
+         if(objects.length() == 0)
+         {
+            MGlobal::displayError("Specify a morphe node to export.");
+            return MS::kFailure;
+         }
+         if(GetMorpheNode(objects[0], objDeformer) != MS::kSuccess)
+            return MS::kFailure;
+
+         unsigned int uExported = 0;
+         status = ExportLibrary(objDeformer, sPath, uExported);
+         if(status != MS::kSuccess)
+            return status;
+
+         clearResult();
+         setResult((int)uExported);
+      }
+
+      // -bakeFrames start end -file path : write a point cache of the result
+      if(argData.isFlagSet(kBakeFramesFlag))
+      {
+         double   dStart = 0.0, dEnd = 0.0;
+         MString  sPath;
+         argData.getFlagArgument(kBakeFramesFlag, 0, dStart);
+         argData.getFlagArgument(kBakeFramesFlag, 1, dEnd);
+         if(!argData.isFlagSet(kFileFlag) || argData.getFlagArgument(kFileFlag, 0, sPath) != MS::kSuccess)
+         {
+            MGlobal::displayError("-bf/bakeFrames needs a -f/file to write.");
+            return MS::kFailure;
+         }
+         if(objects.length() == 0)
+         {
+            MGlobal::displayError("Specify a morphe node to bake.");
+            return MS::kFailure;
+         }
+         if(GetMorpheNode(objects[0], objDeformer) != MS::kSuccess)
+            return MS::kFailure;
+
+         unsigned int uFrames = 0;
+         status = BakeFrames(objDeformer, dStart, dEnd, sPath, uFrames);
+         if(status != MS::kSuccess)
+            return status;
+
+         clearResult();
+         setResult((int)uFrames);
+      }
    }
 
    // Create Mode
    if(!argData.isQuery() && !argData.isEdit())
    {
-      MObject           obj;
-      MFnDependencyNode fnObj;
-      MObject           base;
       MDagPath          dpBase;
       
       MSelectionList    list;
@@ -230,51 +1044,113 @@ MStatus MorpheCmd::doIt (const MArgList &args)
          return MStatus::kFailure;
       }
 
-      // Create the deformer to the last object selected 
+      // Create the deformer to the last object selected, it is the morphe
+      // node that did not exist before
+      MObjectArray      nodesBefore, nodesAfter;
       list.getDagPath(list.length()-1, dpBase);
-      MStringArray strDeformer;
-      MGlobal::executeCommand("deformer -type \"morphe\" " + dpBase.partialPathName(), strDeformer, false, true);
+      GetMorpheNodes(nodesBefore);
+      mCreateModifier.commandToExecute("deformer -type \"morphe\" " + dpBase.fullPathName());
+      status = mCreateModifier.doIt();
+      if(status != MS::kSuccess)
+         return status;
+      GetMorpheNodes(nodesAfter);
 
-      // Get the deformer MObject node and its MPlug weight
-      MSelectionList    listDeformer;
       MObject           objDeformer;
-      listDeformer.add(strDeformer[0]);
-      listDeformer.getDependNode(0, objDeformer);
-
-      // We need to iterate for all objects but base object
-      list.remove(list.length()-1);
-      unsigned int      idx = 0;
-      MItSelectionList  iterList(list, MFn::kTransform, &status);
-      if(MStatus::kFailure == status)
-         return MStatus::kFailure;
-
-      for(; !iterList.isDone(); iterList.next())
+      for(unsigned int i = 0; i < nodesAfter.length() && objDeformer.isNull(); i++)
       {
-         iterList.getDependNode(obj);
-
-         // Create weights attributes for each object selected
-         AddWeight(obj, objDeformer, idx);
-
-         // Connect each object selected to deformer
-         ConnectInputs(obj, objDeformer, idx);
-
-         // Assign names
-         fnObj.setObject(obj);
-         SetTargetName(objDeformer, idx, fnObj.name());
+         bool bExisted = false;
+         for(unsigned int j = 0; j < nodesBefore.length() && !bExisted; j++)
+            bExisted = nodesAfter[i] == nodesBefore[j];
+         if(!bExisted)
+            objDeformer = nodesAfter[i];
+      }
+      if(objDeformer.isNull())
+      {
+         mCreateModifier.undoIt();
+         MGlobal::displayError("Cannot create a morphe deformer on " + dpBase.partialPathName());
+         return MS::kFailure;
+      }
 
-         // Assign the corresponding weight
-         MIntArray uArrWt;
-         uArrWt.append(idx);
-         SetTargetWeight(objDeformer, idx, uArrWt);
+      // Only the connection queued since the creation is done here
+      ConnectTime(mCreateModifier, objDeformer);
+      status = mCreateModifier.doIt();
+      if(status != MS::kSuccess)
+      {
+         mCreateModifier.undoIt();
+         return status;
+      }
+      mUndoable = true;
 
-         idx++;
+      // Every object but the base is a target, all added with one modifier
+      unsigned int      uAdded = 0;
+      list.remove(list.length()-1);
+      status = AddTargets(mModifier, objDeformer, list, uAdded);
+      if(status == MS::kSuccess)
+         status = mModifier.doIt();
+      if(status != MS::kSuccess)
+      {
+         mModifier.undoIt();
+         mCreateModifier.undoIt();
+         mUndoable = false;
+         return status;
       }
 
       // Return morphe name
       clearResult();
-      setResult(strDeformer[0]);
+      setResult(MFnDependencyNode(objDeformer).name());
    }
 
    return MS::kSuccess;
 }
 // -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method redoes the deformer creation and the target edits.
+//
+// Return Values:
+//    MS::kSuccess
+//    MS::kFailure
+//
+MStatus MorpheCmd::redoIt()
+{
+   MStatus status = mCreateModifier.doIt();
+   if(status != MS::kSuccess)
+      return status;
+   return mModifier.doIt();
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method undoes the target edits then the deformer creation.
+//
+// Return Values:
+//    MS::kSuccess
+//    MS::kFailure
+//
+MStatus MorpheCmd::undoIt()
+{
+   MStatus status = mModifier.undoIt();
+   if(status != MS::kSuccess)
+      return status;
+   return mCreateModifier.undoIt();
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    Only target creation is undoable, queries and the other edits are not
+//      recorded.
+//
+// Return Values:
+//    true if the command created a deformer or added targets
+//
+bool MorpheCmd::isUndoable() const
+{
+   return mUndoable;
+}
+// -----------------------------------------------------------------------------
@@ -12,18 +12,34 @@
 #include <maya/MArgDatabase.h>
 #include <maya/MArgList.h>
 #include <maya/MDagPath.h>
+#include <maya/MDGContext.h>
 #include <maya/MDGModifier.h>
+#include <maya/MDoubleArray.h>
 #include <maya/MFnDagNode.h>
+#include <maya/MFnComponentListData.h>
 #include <maya/MFnDependencyNode.h>
 #include <maya/MFnIntArrayData.h>
+#include <maya/MFnMesh.h>
+#include <maya/MFnPointArrayData.h>
+#include <maya/MFnSingleIndexedComponent.h>
 #include <maya/MFnStringData.h>
 #include <maya/MGlobal.h>
+#include <maya/MItDependencyNodes.h>
 #include <maya/MItSelectionList.h>
 #include <maya/MObject.h>
+#include <maya/MObjectArray.h>
 #include <maya/MPlug.h>
+#include <maya/MPlugArray.h>
+#include <maya/MPointArray.h>
 #include <maya/MPxCommand.h>
 #include <maya/MSelectionList.h>
 #include <maya/MSyntax.h>
+#include <maya/MTime.h>
+#include "core/MorpheLibrary.h"
+#include "core/MorphePointCache.h"
+#include "core/MorpheTarget.h"
+
+#include <vector>
 // -----------------------------------------------------------------------------
 
 
@@ -34,11 +50,25 @@ class MorpheCmd : public MPxCommand
 {
 public:
 
-   static  void      AddWeight(MObject &obj, MObject &objDeformer, unsigned int &idx);
-   static  void      SetTargetName(MObject &objDeformer, unsigned int &idxTarget, MString &name);
-   static  void      SetTargetWeight(MObject &objDeformer, unsigned int &idxTarget, MIntArray &idxWeight);
-   static  void      ConnectInputs(MObject &obj, MObject &objDeformer, unsigned int &idx);
+   static  void      AddWeight(MDGModifier &modifier, const MPlug &plugWeight, const MString &name);
+   static  void      SetTargetName(MDGModifier &modifier, const MPlug &plugItem, const MString &name);
+   static  void      SetTargetWeight(MDGModifier &modifier, const MPlug &plugItem, const MIntArray &idxWeight);
+   static  void      ConnectInputs(MDGModifier &modifier, const MDagPath &dpTarget, const MPlug &plugItem);
+   static  void      ConnectTime(MDGModifier &modifier, const MObject &objDeformer);
+   static  MStatus   AddTargets(MDGModifier &modifier, const MObject &objDeformer, MSelectionList &targets, unsigned int &uAdded);
+   static  void      GetMorpheNodes(MObjectArray &nodes);
+   static  MStatus   GetMorpheNode(const MString &name, MObject &objDeformer);
+   static  bool      GetPlugTarget(const MPlug &plugGeo, const MPlug &plugPoints, const MPlug &plugComponents, const std::vector<float> &baseXYZ, MorpheTarget &target, MPlug &plugSrc);
+   static  void      SetBakedTarget(const MorpheTarget &target, MPlug plugPoints, MPlug plugComponents);
+   static  MStatus   BakeTargets(MObject &objDeformer, unsigned int &uBaked);
+   static  void      ClearBakedTarget(MPlug plugPoints, MPlug plugComponents);
+   static  MStatus   ExportLibrary(MObject &objDeformer, const MString &sPath, unsigned int &uExported);
+   static  MStatus   BakeFrames(MObject &objDeformer, double dStart, double dEnd, const MString &sPath, unsigned int &uFrames);
+                     MorpheCmd();
    virtual MStatus   doIt(const MArgList &args);
+   virtual MStatus   redoIt();
+   virtual MStatus   undoIt();
+   virtual bool      isUndoable() const;
    static  MSyntax   newSyntax();
    static  void*     creator();
 
@@ -46,7 +76,10 @@ private:
 
    MStatus           parseArgs(const MArgList &args);
 
-   MStringArray      sCreateMorphes;
+   MSelectionList    mCreateMorphes;      // Targets of -createMorphes
+   MDGModifier       mCreateModifier;     // Deformer creation
+   MDGModifier       mModifier;           // Target weights, names and connections
+   bool              mUndoable;
 };
 // -----------------------------------------------------------------------------
 
@@ -56,6 +89,31 @@ private:
 //
 #define kCreateMorphesFlag        "-cms"
 #define kCreateMorphesFlagLong    "-createMorphes"
+#define kBakeFlag                 "-bk"
+#define kBakeFlagLong             "-bake"
+#define kBakeFramesFlag           "-bf"
+#define kBakeFramesFlagLong       "-bakeFrames"
+#define kExportLibraryFlag        "-el"
+#define kExportLibraryFlagLong    "-exportLibrary"
+#define kFileFlag                 "-f"
+#define kFileFlagLong             "-file"
+#define kCacheStatsFlag           "-cst"
+#define kCacheStatsFlagLong       "-cacheStats"
+#define kResultCacheStatsFlag     "-rcs"
+#define kResultCacheStatsFlagLong "-resultCacheStats"
+#define kQuantizeErrorFlag        "-qe"
+#define kQuantizeErrorFlagLong    "-quantizeError"
+#define kBasisErrorFlag           "-be"
+#define kBasisErrorFlagLong       "-basisError"
+#define kStatsFlag                "-st"
+#define kStatsFlagLong            "-stats"
+#define kResetStatsFlag           "-rst"
+#define kResetStatsFlagLong       "-resetStats"
+// -----------------------------------------------------------------------------
+
+
+// Frames evaluated together by -bakeFrames, bounds the memory of a bake.
+#define MORPHE_FRAME_BLOCK        16
 // -----------------------------------------------------------------------------
 
 #endif
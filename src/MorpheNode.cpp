@@ -7,205 +7,1582 @@
 // Includes
 //
 #include "MorpheNode.h"
+
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+// -----------------------------------------------------------------------------
+
+
+MTypeId MorpheNode::id(MORPHE_ID);
+// -----------------------------------------------------------------------------
+
+
+//
+// Attributes
+//
+int     MorpheNode::profilerCategory = -1;
+MObject MorpheNode::aWeight;
+MObject MorpheNode::aCompression;
+MObject MorpheNode::aLibraryPath;
+MObject MorpheNode::aIncremental;
+MObject MorpheNode::aBasis;
+MObject MorpheNode::aBasisTolerance;
+MObject MorpheNode::aBasisMaxShapes;
+MObject MorpheNode::aResultCache;
+MObject MorpheNode::aResultCacheBudget;
+MObject MorpheNode::aStreaming;
+MObject MorpheNode::aStreamWindow;
+MObject MorpheNode::aStreamBudget;
+MObject MorpheNode::aTime;
+MObject MorpheNode::aMorpheItem;
+MObject MorpheNode::aMorpheName;
+MObject MorpheNode::aMorpheWeights;
+MObject MorpheNode::aMorpheExpression;
+MObject MorpheNode::aMorpheGeometry;
+MObject MorpheNode::aMorphePoints;
+MObject MorpheNode::aMorpheComponents;
+MObject MorpheNode::aMorpheTargetWeights;
+MObject MorpheNode::aMorpheInbetween;
+MObject MorpheNode::aMorpheInbetweenWeight;
+MObject MorpheNode::aMorpheInbetweenGeometry;
+MObject MorpheNode::aMorpheInbetweenPoints;
+MObject MorpheNode::aMorpheInbetweenComponents;
+// -----------------------------------------------------------------------------
+
+
+//
+// MorpheStatsScope - Adds the time spent in a scope to a stats counter and
+//    shows the scope in the Maya profiler
+//
+class MorpheStatsScope
+{
+   public:
+      MorpheStatsScope(double &dTotal, const char *pName)
+         : mTotal(dTotal), mScope(MorpheNode::profilerCategory, MProfiler::kColorE_L1, pName)
+      {
+         mTimer.beginTimer();
+      }
+
+      ~MorpheStatsScope()
+      {
+         mTimer.endTimer();
+         mTotal += mTimer.elapsedTime();
+      }
+
+   private:
+      double            &mTotal;
+      MTimer            mTimer;
+      MProfilingScope   mScope;
+};
+// -----------------------------------------------------------------------------
+
+
+//
+// Constructor
+//
+MorpheNode::MorpheNode() : mWeightIndexDirty(true), mIndexedItemCount(0), mActiveStamp(0), mActiveDirty(true), mLibraryDirty(true), mCurveEditedId(0), mStreamStamp(0), mStreamEvictions(0), mCacheHits(0), mCacheMisses(0), mInputVersion(0)
+{
+   ResetStats();
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Destructor
+//
+MorpheNode::~MorpheNode()
+{
+   if(mCurveEditedId != 0)
+      MMessage::removeCallback(mCurveEditedId);
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method watches the anim curve edits, to sample the curves that
+//      drive the weights again.
+//
+void MorpheNode::postConstructor()
+{
+   mCurveEditedId = MAnimMessage::addAnimCurveEditedCallback(AnimCurveEdited, this);
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method reads every weight once, indexed by logical index. Missing
+//      elements are zero.
+//
+// Return Values:
+//    MS::kSuccess
+//    MS::kFailure
+//
+MStatus MorpheNode::GetWeights(MDataBlock &data, std::vector<float> &weights)
+{
+   MStatus status;
+   weights.clear();
+
+   // Get array of weights
+   MArrayDataHandle hArrWeight = data.inputArrayValue(aWeight, &status);
+   if (status != MS::kSuccess)
+      return status;
+
+   unsigned int uWeightCount = hArrWeight.elementCount();
+   for(unsigned int i = 0; i < uWeightCount; i++, hArrWeight.next())
+   {
+      unsigned int uWeightIdx = hArrWeight.elementIndex();
+      if(uWeightIdx >= weights.size())
+         weights.resize(uWeightIdx + 1, 0.0f);
+      weights[uWeightIdx] = hArrWeight.inputValue().asFloat();
+   }
+   return MS::kSuccess;
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method rebuilds the index from weight ids to the items they drive
+//      and compiles the item expressions. An item whose expression does not
+//      compile is weighted by its weights, with a warning.
+//
+void MorpheNode::BuildWeightIndex(MDataBlock &data)
+{
+   mWeightIndex.Clear();
+
+   MorpheExpression expression;
+   std::string sError;
+
+   MArrayDataHandle hArrMorpheItem = data.inputArrayValue(aMorpheItem);
+   unsigned int targetArrayCount = hArrMorpheItem.elementCount();
+   for(unsigned int i = 0; i < targetArrayCount; i++, hArrMorpheItem.next())
+   {
+      MDataHandle hMorpheItem = hArrMorpheItem.inputValue();
+      MFnIntArrayData arrMorpheWeightsIds(hMorpheItem.child(aMorpheWeights).data());
+      MIntArray ids = arrMorpheWeightsIds.array();
+
+      expression.Clear();
+      MString sExpression = hMorpheItem.child(aMorpheExpression).asString();
+      if(sExpression.length() > 0 && !expression.Compile(sExpression.asChar(), &sError))
+      {
+         MString sItem;
+         sItem += hArrMorpheItem.elementIndex();
+         MGlobal::displayWarning("morphe: morpheItem[" + sItem + "] expression, " + MString(sError.c_str()));
+      }
+
+      if(ids.length() > 0 || !expression.IsEmpty())
+         mWeightIndex.SetItem(hArrMorpheItem.elementIndex(), ids.length() > 0 ? &ids[0] : NULL, ids.length(), &expression);
+   }
+
+   mIndexedItemCount = targetArrayCount;
+   mWeightIndexDirty = false;
+   mActiveDirty      = true;
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method returns the items with a non zero weight, parents first
+//      then combinations by number of weights. The set is computed once for
+//      every geometry the node deforms and only again when a weight or the
+//      weight index changed; mActiveStamp changes along with it.
+//
+// Return Values:
+//    the active items
+//
+const MorpheActiveArray &MorpheNode::GetActiveItems(MDataBlock &data)
+{
+   MorpheStatsScope scope(mStats.gatherTime, "Gather weights");
+
+   // Items added or removed since the index was built
+   MArrayDataHandle hArrMorpheItem = data.inputArrayValue(aMorpheItem);
+   if(hArrMorpheItem.elementCount() != mIndexedItemCount)
+      mWeightIndexDirty = true;
+   if(mWeightIndexDirty)
+      BuildWeightIndex(data);
+
+   std::vector<float> weights;
+   GetWeights(data, weights);
+   if(mActiveDirty || weights != mWeights)
+   {
+      mWeights.swap(weights);
+      mWeightIndex.GetActive(mWeights, mActive);
+      mActiveDirty = false;
+
+      // 0 marks deltas that were never accumulated
+      if(++mActiveStamp == 0)
+         mActiveStamp = 1;
+   }
+   return mActive;
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method converts points to the xyz floats used by the core.
+//
+void MorpheNode::GetFloatPoints(const MPointArray &pts, std::vector<float> &xyz)
+{
+   xyz.resize(pts.length() * 3);
+   for(unsigned int j = 0; j < pts.length(); j++)
+   {
+      xyz[3*j]   = (float)pts[j].x;
+      xyz[3*j+1] = (float)pts[j].y;
+      xyz[3*j+2] = (float)pts[j].z;
+   }
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method copies the points of a mesh to xyz floats straight from its
+//      raw point buffer, without going through an MPointArray.
+//
+// Return Values:
+//    the point count, 0 if the object is not a mesh
+//
+unsigned int MorpheNode::GetMeshPoints(const MObject &oMesh, std::vector<float> &xyz)
+{
+   MStatus status;
+   xyz.clear();
+   if(oMesh.isNull())
+      return 0;
+
+   MFnMesh fnMesh(oMesh, &status);
+   const float *pPoints = status == MS::kSuccess ? fnMesh.getRawPoints(&status) : NULL;
+   if(pPoints == NULL || status != MS::kSuccess)
+      return 0;
+
+   unsigned int uCount = (unsigned int)fnMesh.numVertices();
+   xyz.assign(pPoints, pPoints + (size_t)uCount * 3);
+   return uCount;
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method finds the output mesh of a geometry index when the
+//      deformer moves every one of its vertices, in order. Its points are
+//      then read raw and set at once instead of going through the iterator.
+//      Before deform writes it, it holds the input points.
+//
+// Return Values:
+//    true if fnMesh is set to the output mesh
+//
+bool MorpheNode::GetOutputMesh(MDataBlock &data, unsigned int mIndex, unsigned int uCount, MFnMesh &fnMesh)
+{
+   MStatus status;
+   MArrayDataHandle hArrOutput = data.outputArrayValue(outputGeom, &status);
+   if(status != MS::kSuccess || hArrOutput.jumpToElement(mIndex) != MS::kSuccess)
+      return false;
+
+   MObject oMesh = hArrOutput.outputValue().asMesh();
+   if(oMesh.isNull() || fnMesh.setObject(oMesh) != MS::kSuccess)
+      return false;
+   return (unsigned int)fnMesh.numVertices() == uCount;
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method reads baked deltas: the vertex indices stored in a
+//      component list and their deltas in a point array.
+//
+// Return Values:
+//    true if the item holds baked deltas
+//
+bool MorpheNode::GetBakedTarget(const MObject &oPoints, const MObject &oComponents, std::vector<int> &components, std::vector<float> &deltas)
+{
+   components.clear();
+   deltas.clear();
+
+   if(oPoints.isNull() || oComponents.isNull())
+      return false;
+
+   MFnPointArrayData fnPoints(oPoints);
+   GetFloatPoints(fnPoints.array(), deltas);
+
+   MFnComponentListData fnComponents(oComponents);
+   for(unsigned int c = 0; c < fnComponents.length(); c++)
+   {
+      MIntArray elements;
+      MFnSingleIndexedComponent fnComp(fnComponents[c]);
+      fnComp.getElements(elements);
+      for(unsigned int k = 0; k < elements.length(); k++)
+         components.push_back(elements[k]);
+   }
+
+   return !components.empty() && components.size() * 3 == deltas.size();
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method reads the painted weights of an item. Only the elements
+//      that exist are returned; missing ones weigh 1.
+//
+void MorpheNode::GetTargetWeights(MDataHandle &hMorpheItem, std::vector<unsigned int> &indices, std::vector<float> &values)
+{
+   indices.clear();
+   values.clear();
+
+   MArrayDataHandle hArrTargetWeights(hMorpheItem.child(aMorpheTargetWeights));
+   unsigned int uCount = hArrTargetWeights.elementCount();
+   for(unsigned int i = 0; i < uCount; i++, hArrTargetWeights.next())
+   {
+      indices.push_back(hArrTargetWeights.elementIndex());
+      values.push_back(hArrTargetWeights.inputValue().asFloat());
+   }
+}
+
+void MorpheNode::GetTargetWeights(const MPlug &plugItem, std::vector<unsigned int> &indices, std::vector<float> &values)
+{
+   indices.clear();
+   values.clear();
+
+   MPlug plugArrTargetWeights = plugItem.child(aMorpheTargetWeights);
+   unsigned int uCount = plugArrTargetWeights.numElements();
+   for(unsigned int i = 0; i < uCount; i++)
+   {
+      MPlug plugTargetWeight = plugArrTargetWeights.elementByPhysicalIndex(i);
+      indices.push_back(plugTargetWeight.logicalIndex());
+      values.push_back(plugTargetWeight.asFloat());
+   }
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method builds a target from a live mesh, or else from baked points
+//      and components.
+//
+// Return Values:
+//    true if there was a target, bLive tells whether it came from a mesh
+//
+bool MorpheNode::BuildTarget(MObject oMesh, const MObject &oPoints, const MObject &oComponents, MItGeometry &itGeo, const MObject &oBase, std::vector<float> &origXYZ, MorpheTarget &target, bool &bLive)
+{
+   std::vector<float>   targetXYZ;
+   std::vector<int>     bakedComponents;
+   unsigned int         uVertexCount = itGeo.count();
+
+   bLive = !oMesh.isNull();
+   if(bLive)
+   {
+      // Live target mesh, read in place from its raw float points
+      MFnMesh        fnMorpheGeometry(oMesh);
+      const float    *pTargetXYZ = fnMorpheGeometry.getRawPoints();
+      unsigned int   uTargetCount = (unsigned int)fnMorpheGeometry.numVertices();
+      if(pTargetXYZ == NULL || uTargetCount == 0)
+         return false;
+
+      // Original positions are only fetched once a target has to be built,
+      // from the raw points of the base mesh when deform gives it
+      if(origXYZ.empty() && GetMeshPoints(oBase, origXYZ) != uVertexCount)
+      {
+         MPointArray origPts;
+         itGeo.allPositions(origPts);
+         GetFloatPoints(origPts, origXYZ);
+      }
+
+      target.Build(pTargetXYZ, &origXYZ[0], uTargetCount, uVertexCount, MORPHE_ZERO_THRESHOLD);
+      return true;
+   }
+
+   if(GetBakedTarget(oPoints, oComponents, bakedComponents, targetXYZ))
+   {
+      // Baked deltas, see MorpheCmd::BakeTargets
+      target.Build(&bakedComponents[0], &targetXYZ[0], (unsigned int)bakedComponents.size(), uVertexCount);
+      return true;
+   }
+
+   return false;
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method builds the shapes of an item, its target and in-betweens,
+//      scaled by its painted weights. Combination items built from a mesh
+//      are made relative to their parents, already built and relative
+//      themselves; baked ones already are. Items without a mesh or baked data are read
+//      from the target library.
+//
+// Return Values:
+//    true if the item has a target
+//
+bool MorpheNode::BuildItem(MDataHandle &hMorpheItem, unsigned int uItemIdx, MItGeometry &itGeo, std::vector<float> &origXYZ, const std::vector<const MorpheItem*> &parents, MorpheItem &item)
+{
+   bool bLive = false;
+   if(!BuildTarget(hMorpheItem.child(aMorpheGeometry).asMesh(), hMorpheItem.child(aMorphePoints).data(),
+                   hMorpheItem.child(aMorpheComponents).data(), itGeo, mOutputMesh, origXYZ, item.target, bLive))
+   {
+      // Library items are stored with their in-betweens, already relative
+      int iRecord = mLibrary.Find(uItemIdx);
+      if(iRecord < 0 || mLibrary.VertexCount() != (unsigned int)itGeo.count())
+         return false;
+
+      std::vector<int> weightIds = item.weightIds;
+      if(!mLibrary.Load((unsigned int)iRecord, item))
+         return false;
+      if(!weightIds.empty())
+         item.SetWeightIds(&weightIds[0], (unsigned int)weightIds.size());
+
+      ApplyTargetWeights(hMorpheItem, item);
+      return true;
+   }
+
+   // In-betweens
+   MArrayDataHandle hArrInbetween(hMorpheItem.child(aMorpheInbetween));
+   unsigned int uInbetweenCount = hArrInbetween.elementCount();
+   for(unsigned int k = 0; k < uInbetweenCount; k++, hArrInbetween.next())
+   {
+      MDataHandle    hInbetween = hArrInbetween.inputValue();
+      MorpheTarget   inbetween;
+      bool           bInbetweenLive;
+      if(BuildTarget(hInbetween.child(aMorpheInbetweenGeometry).asMesh(), hInbetween.child(aMorpheInbetweenPoints).data(),
+                     hInbetween.child(aMorpheInbetweenComponents).data(), itGeo, mOutputMesh, origXYZ, inbetween, bInbetweenLive))
+         item.AddInbetween(hInbetween.child(aMorpheInbetweenWeight).asFloat()) = inbetween;
+   }
+   item.BuildSegments();
+
+   if(bLive && item.IsCombination())
+      item.MakeCorrective(parents, MORPHE_ZERO_THRESHOLD);
+
+   ApplyTargetWeights(hMorpheItem, item);
+   return true;
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method folds the painted weights of an item into its deltas.
+//
+void MorpheNode::ApplyTargetWeights(MDataHandle &hMorpheItem, MorpheItem &item)
+{
+   std::vector<unsigned int>  maskIndices;
+   std::vector<float>         maskValues;
+   GetTargetWeights(hMorpheItem, maskIndices, maskValues);
+   if(!maskIndices.empty())
+      item.ApplyWeights(&maskIndices[0], &maskValues[0], (unsigned int)maskIndices.size(), MORPHE_ZERO_THRESHOLD);
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method maps the library file named by libraryPath, if any.
+//
+void MorpheNode::OpenLibrary(MDataBlock &data)
+{
+   mStream.Reset(NULL);
+   mLibrary.Close();
+   mLibraryDirty = false;
+
+   MString sPath = data.inputValue(aLibraryPath).asString();
+   if(sPath.length() > 0 && !mLibrary.Open(sPath.asChar()))
+      MGlobal::displayWarning("morphe: cannot read target library " + sPath);
+   mStream.Reset(&mLibrary);
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method returns the cached item of a geometry, building it first
+//      if it is missing or was built against another vertex count. The
+//      parents of a combination item are fetched along with it. When
+//      streaming, items read from the target library come from the stream
+//      instead, shared by every geometry of the library vertex count.
+//
+// Return Values:
+//    the item, NULL if it has no target
+//
+MorpheItem* MorpheNode::FetchItem(MArrayDataHandle &hArrMorpheItem, MItGeometry &itGeo, unsigned int mIndex, unsigned int uItemIdx, unsigned int uVertexCount, bool bQuantize, bool bStream, std::vector<float> &origXYZ)
+{
+   MorpheItemMap &items = mItems[mIndex];
+
+   MorpheItemMap::iterator it = items.find(uItemIdx);
+   if(it != items.end() && it->second.target.vertexCount == uVertexCount)
+   {
+      mCacheHits++;
+      return &it->second;
+   }
+
+   // Library items, without a mesh nor baked points
+   if(bStream && mLibrary.VertexCount() == uVertexCount && mLibrary.Find(uItemIdx) >= 0)
+   {
+      hArrMorpheItem.jumpToElement(uItemIdx);
+      MDataHandle hMorpheItem = hArrMorpheItem.inputValue();
+      if(hMorpheItem.child(aMorpheGeometry).asMesh().isNull() &&
+         (hMorpheItem.child(aMorphePoints).data().isNull() || hMorpheItem.child(aMorpheComponents).data().isNull()))
+      {
+         MorpheStatsScope scope(mStats.fetchTime, "Stream targets");
+         bool bLoaded = false;
+         MorpheItem *pItem = mStream.Get(uItemIdx, bLoaded);
+         if(pItem == NULL)
+            return NULL;
+         if(!bLoaded)
+         {
+            mCacheHits++;
+            return pItem;
+         }
+
+         mCacheMisses++;
+         MFnIntArrayData arrMorpheWeightsIds(hMorpheItem.child(aMorpheWeights).data());
+         MIntArray ids = arrMorpheWeightsIds.array();
+         if(ids.length() > 0)
+            pItem->SetWeightIds(&ids[0], ids.length());
+         ApplyTargetWeights(hMorpheItem, *pItem);
+         if(bQuantize)
+            pItem->Quantize();
+         return pItem;
+      }
+   }
+
+   mCacheMisses++;
+
+   hArrMorpheItem.jumpToElement(uItemIdx);
+   MDataHandle hMorpheItem = hArrMorpheItem.inputValue();
+   MFnIntArrayData arrMorpheWeightsIds(hMorpheItem.child(aMorpheWeights).data());
+
+   MorpheItem item;
+   MIntArray ids = arrMorpheWeightsIds.array();
+   if(ids.length() > 0)
+      item.SetWeightIds(&ids[0], ids.length());
+
+   // A combination built from a mesh is made relative to every item of a
+   // subset of its weights, whatever their weight or expression, so it does
+   // not depend on which items were evaluated before
+   std::vector<const MorpheItem*> parents;
+   if(item.IsCombination() && !hMorpheItem.child(aMorpheGeometry).asMesh().isNull())
+   {
+      std::vector<unsigned int> parentItems;
+      mWeightIndex.GetParents(item.weightIds, parentItems);
+      for(size_t i = 0; i < parentItems.size(); i++)
+      {
+         MorpheItem *pParent = FetchItem(hArrMorpheItem, itGeo, mIndex, parentItems[i], uVertexCount, bQuantize, bStream, origXYZ);
+         if(pParent != NULL)
+            parents.push_back(pParent);
+      }
+      hArrMorpheItem.jumpToElement(uItemIdx);
+      hMorpheItem = hArrMorpheItem.inputValue();
+   }
+
+   MorpheStatsScope scope(mStats.fetchTime, "Fetch targets");
+
+   // The kept deltas may refer to the item being replaced
+   if(it != items.end())
+   {
+      std::map<unsigned int, MorpheGeometryDeltas>::iterator itDeltas = mDeltas.find(mIndex);
+      if(itDeltas != mDeltas.end())
+      {
+         itDeltas->second.activeStamp = 0;
+         itDeltas->second.incremental.Reset();
+         itDeltas->second.basis.Clear();
+         itDeltas->second.tiles.Clear();
+      }
+      items.erase(it);
+   }
+
+   if(!BuildItem(hMorpheItem, uItemIdx, itGeo, origXYZ, parents, item))
+      return NULL;
+   if(bQuantize)
+      item.Quantize();
+
+   return &items.insert(MorpheItemMap::value_type(uItemIdx, item)).first->second;
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method gathers the weighted shapes of a set of active items.
+//      Items are kept sparse per geometry and only rebuilt after
+//      setDependentsDirty invalidated them or the base vertex count changed.
+//      Combination items come after their parents in the active set and
+//      are skipped when any weight is zero.
+//
+// Return Values:
+//    MS::kSuccess
+//    MS::kFailure
+//
+MStatus MorpheNode::GetTerms(MDataBlock &data, MItGeometry &itGeo, unsigned int mIndex, unsigned int uVertexCount, const MorpheActiveArray &active, float fEnv, std::vector<float> &origXYZ, MorpheTermArray &terms)
+{
+   MStatus status;
+
+   // Get array of morphes
+   MArrayDataHandle hArrMorpheItem = data.inputArrayValue(aMorpheItem, &status);
+   if (status != MS::kSuccess)
+      return MS::kSuccess;
+
+   unsigned int targetArrayCount = hArrMorpheItem.elementCount();
+   if (targetArrayCount == 0 || uVertexCount == 0)
+      return MS::kSuccess;
+
+   if(mLibraryDirty)
+      OpenLibrary(data);
+
+   bool bQuantize = data.inputValue(aCompression).asShort() == MORPHE_COMPRESSION_QUANTIZED;
+   bool bStream   = data.inputValue(aStreaming).asBool();
+
+   mStats.activeItems = (unsigned int)active.size();
+
+   for(size_t a = 0; a < active.size(); a++)
+   {
+      MorpheItem *pItem = FetchItem(hArrMorpheItem, itGeo, mIndex, active[a].item, uVertexCount, bQuantize, bStream, origXYZ);
+      if(pItem != NULL)
+         pItem->GetTerms(active[a].weight, fEnv, terms);
+   }
+
+   return MS::kSuccess;
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method fetches every item of a geometry and reduces all their
+//      shapes, targets and in-betweens, to the principal shapes within the
+//      basisTolerance error, see MorpheBasis.
+//
+void MorpheNode::BuildBasis(MDataBlock &data, MItGeometry &itGeo, unsigned int mIndex, unsigned int uVertexCount, MorpheBasis &basis)
+{
+   MStatus status;
+   MorpheStatsScope scope(mStats.fetchTime, "Build basis");
+
+   basis.Clear();
+   MArrayDataHandle hArrMorpheItem = data.inputArrayValue(aMorpheItem, &status);
+   if(status != MS::kSuccess || uVertexCount == 0)
+      return;
+
+   if(mLibraryDirty)
+      OpenLibrary(data);
+
+   bool  bQuantize  = data.inputValue(aCompression).asShort() == MORPHE_COMPRESSION_QUANTIZED;
+   float tolerance  = data.inputValue(aBasisTolerance).asFloat();
+   int   iMaxShapes = data.inputValue(aBasisMaxShapes).asInt();
+
+   // Every item with all its weights at 1, parents come first
+   std::vector<float> ones(mWeightIndex.WeightCount(), 1.0f);
+   MorpheActiveArray all;
+   mWeightIndex.GetActive(ones, all);
+
+   std::vector<float> origXYZ;
+   std::vector<const MorpheTarget*> targets;
+   for(size_t a = 0; a < all.size(); a++)
+   {
+      MorpheItem *pItem = FetchItem(hArrMorpheItem, itGeo, mIndex, all[a].item, uVertexCount, bQuantize, false, origXYZ);
+      if(pItem == NULL)
+         continue;
+      targets.push_back(&pItem->target);
+      for(size_t k = 0; k < pItem->inbetweens.size(); k++)
+         targets.push_back(&pItem->inbetweens[k]);
+   }
+
+   basis.Build(targets, uVertexCount, tolerance, iMaxShapes > 0 ? (unsigned int)iMaxShapes : 0, &mParallel);
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method gets the final deltas position for each vertex of a
+//      geometry, from the current weights. The deltas kept for the geometry
+//      are reused as long as the active set, the envelope and the items
+//      are the same, so a geometry evaluated again for another reason, such
+//      as painted weights, does not accumulate anything. In basis mode the
+//      shapes are accumulated through the principal shapes of the geometry;
+//      the basis needs every item, so it is not used when streaming.
+//
+// Return Values:
+//    MS::kSuccess
+//    MS::kFailure
+//
+MStatus MorpheNode::GetTargetsDeltas(MDataBlock &data, MItGeometry &itGeo, unsigned int mIndex, unsigned int uVertexCount, float fEnv, MorpheGeometryDeltas &geoDeltas)
+{
+   std::vector<float> origXYZ;
+   MorpheTermArray terms;
+
+   const MorpheActiveArray &active = GetActiveItems(data);
+   if(geoDeltas.activeStamp == mActiveStamp && geoDeltas.envelope == fEnv && geoDeltas.deltas.Count() == uVertexCount)
+   {
+      mStats.activeItems = (unsigned int)active.size();
+      return MS::kSuccess;
+   }
+
+   bool bBasis = data.inputValue(aBasis).asBool() && !data.inputValue(aStreaming).asBool();
+   if(bBasis && !geoDeltas.basis.IsBuilt())
+      BuildBasis(data, itGeo, mIndex, uVertexCount, geoDeltas.basis);
+
+   GetTerms(data, itGeo, mIndex, uVertexCount, active, fEnv, origXYZ, terms);
+
+   {
+      MorpheStatsScope scope(mStats.accumulateTime, "Accumulate");
+      geoDeltas.deltas.Resize(uVertexCount);
+      if(bBasis)
+         geoDeltas.basis.Accumulate(terms, geoDeltas.deltas, &mParallel);
+      else
+         geoDeltas.tiles.Accumulate(terms, geoDeltas.deltas, &mParallel);
+   }
+   geoDeltas.activeStamp = mActiveStamp;
+   geoDeltas.envelope    = fEnv;
+   geoDeltas.termCount   = (unsigned int)terms.size();
+   mStats.terms = geoDeltas.termCount;
+
+   return MS::kSuccess;
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method brings the deltas kept for a geometry up to date with the
+//      current weights, accumulating only the shapes whose weight changed
+//      since the last evaluation, see MorpheIncremental.
+//
+// Return Values:
+//    MS::kSuccess
+//    MS::kFailure
+//
+MStatus MorpheNode::GetIncrementalDeltas(MDataBlock &data, MItGeometry &itGeo, unsigned int mIndex, unsigned int uVertexCount, float fEnv, MorpheIncremental &incremental)
+{
+   std::vector<float> origXYZ;
+   MorpheTermArray terms;
+
+   GetTerms(data, itGeo, mIndex, uVertexCount, GetActiveItems(data), fEnv, origXYZ, terms);
+
+   {
+      MorpheStatsScope scope(mStats.accumulateTime, "Accumulate");
+      mStats.terms = incremental.Update(terms, uVertexCount, &mParallel);
+   }
+
+   return MS::kSuccess;
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method gets the deltas of several frames of the first geometry at
+//      once, from weights sampled by the caller. Items are fetched once for
+//      the whole batch and the frames are accumulated together, see
+//      MorpheAccumulateFrames. The painted weights are returned apart, as
+//      for deform. Used by morphe -bakeFrames.
+//
+// Return Values:
+//    MS::kSuccess
+//    MS::kFailure
+//
+MStatus MorpheNode::EvaluateFrames(const std::vector< std::vector<float> > &frameWeights, const std::vector<float> &frameEnvelopes, std::vector<MorpheDeltas> &frameDeltas, MorpheWeightMap &weightMap)
+{
+   MStatus status;
+   MDataBlock data = forceCache();
+
+   // Input geometry the items are built against
+   MArrayDataHandle hArrInput = data.inputArrayValue(input, &status);
+   if(status != MS::kSuccess || hArrInput.jumpToElement(0) != MS::kSuccess)
+      return MS::kFailure;
+   MDataHandle hInputGeom = hArrInput.inputValue().child(inputGeom);
+   MItGeometry itGeo(hInputGeom, true);
+
+   unsigned int uVertexCount = itGeo.count();
+   BuildWeightMap(data, 0, uVertexCount, weightMap);
+
+   // Weight index of the current items, the frames have their own active sets
+   GetActiveItems(data);
+
+   std::vector<float> origXYZ;
+   MorpheActiveArray active;
+   std::vector<MorpheTermArray> frameTerms(frameWeights.size());
+   frameDeltas.resize(frameWeights.size());
+   for(size_t f = 0; f < frameWeights.size(); f++)
+   {
+      frameDeltas[f].Resize(uVertexCount);
+      if(frameEnvelopes[f] > 0.0f)
+      {
+         mWeightIndex.GetActive(frameWeights[f], active);
+         GetTerms(data, itGeo, 0, uVertexCount, active, frameEnvelopes[f], origXYZ, frameTerms[f]);
+      }
+   }
+
+   MorpheAccumulateFrames(frameTerms, frameDeltas, &mParallel);
+
+   return MS::kSuccess;
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method performs the deformation algorithm. A status code of
+//      MS::kSuccess should be returned unless there was a problem during
+//      the deformation, such as insufficient memory or required input
+//      data is missing or invalid.
+//
+// Return Values:
+//    MS::kSuccess
+//    MS::kFailure
+//
+MStatus MorpheNode::deform(MDataBlock &data, MItGeometry &itGeo, const MMatrix &localToWorldMatrix, unsigned int mIndex)
+{
+   MStatus status;
+
+   // Check Node State
+   MDataHandle hNodeState = data.inputValue(state, &status);
+   int nNodeState = hNodeState.asShort() ;
+   if (nNodeState == 1)
+      return MS::kSuccess;
+
+   // Envelope data from the base class
+   // The envelope is simply a scale factor
+   MDataHandle hEnvelope = data.inputValue(envelope, &status);
+   float fEnv = hEnvelope.asFloat();
+   if(fEnv <= 0.0) // If off... done!
+      return MS::kSuccess;
+
+   mStats.evaluations++;
+   mStats.activeItems     = 0;
+   mStats.terms           = 0;
+   mStats.verticesTouched = 0;
+
+   // Painted weights, kept until the weight list is dirtied
+   unsigned int uCount = itGeo.count();
+   MorpheWeightMap &weightMap = mWeightMaps[mIndex];
+   if(weightMap.Count() != uCount)
+   {
+      MorpheStatsScope scope(mStats.gatherTime, "Gather weights");
+      BuildWeightMap(data, mIndex, uCount, weightMap);
+   }
+   if(weightMap.indices.empty())
+      return MS::kSuccess;
+
+   // Points already computed for these inputs are written back as they are
+   bool bResultCache = data.inputValue(aResultCache).asBool();
+   std::vector<unsigned int> resultKey;
+   if(bResultCache)
+   {
+      mResultCache.SetBudget((size_t)data.inputValue(aResultCacheBudget).asInt() << 20);
+      GetResultKey(data, mIndex, uCount, fEnv, resultKey);
+
+      const std::vector<float> *pResult = mResultCache.Find(resultKey);
+      if(pResult)
+      {
+         MorpheStatsScope scope(mStats.writeTime, "Write cached points");
+         MFnMesh fnOutput;
+         if(GetOutputMesh(data, mIndex, uCount, fnOutput))
+            fnOutput.setPoints(MFloatPointArray((const float (*)[4])&(*pResult)[0], uCount));
+         else
+            itGeo.setAllPositions(MPointArray((const float (*)[4])&(*pResult)[0], uCount));
+         return MS::kSuccess;
+      }
+   }
+
+   if(data.inputValue(aStreaming).asBool())
+      StreamTargets(data);
+
+   // The output mesh still holds the input points, targets are built
+   // against its raw points
+   MFnMesh fnOutput;
+   bool    bRaw = GetOutputMesh(data, mIndex, uCount, fnOutput);
+   mOutputMesh  = bRaw ? fnOutput.object() : MObject();
+
+   // Get Targets, from scratch or updating the kept deltas
+   MorpheGeometryDeltas &geoDeltas = mDeltas[mIndex];
+   const MorpheDeltas *pDeltas;
+   if(data.inputValue(aIncremental).asBool())
+   {
+      GetIncrementalDeltas(data, itGeo, mIndex, uCount, fEnv, geoDeltas.incremental);
+      pDeltas = geoDeltas.incremental.IsEmpty() ? NULL : &geoDeltas.incremental.Deltas();
+   }
+   else
+   {
+      GetTargetsDeltas(data, itGeo, mIndex, uCount, fEnv, geoDeltas);
+      pDeltas = geoDeltas.termCount == 0 ? NULL : &geoDeltas.deltas;
+   }
+   mOutputMesh = MObject();
+   if(pDeltas == NULL)
+      return MS::kSuccess;
+
+   // Only the painted points are moved, then written back at once
+   MorpheStatsScope scope(mStats.writeTime, "Write points");
+   mStats.verticesTouched = (unsigned int)weightMap.indices.size();
+   std::vector<float> *pResult = bResultCache ? mResultCache.Insert(resultKey, (size_t)uCount * 4) : NULL;
+
+   if(!bRaw)
+   {
+      // Other geometries, through the iterator
+      MPointArray pts;
+      itGeo.allPositions(pts);
+      for(size_t k = 0; k < weightMap.indices.size(); k++)
+      {
+         unsigned int j  = weightMap.indices[k];
+         float        wt = weightMap.values[j];
+         MPoint       &pt = pts[j];
+         pt.x += pDeltas->x[j] * wt;
+         pt.y += pDeltas->y[j] * wt;
+         pt.z += pDeltas->z[j] * wt;
+      }
+      itGeo.setAllPositions(pts);
+      if(pResult)
+         pts.get((float (*)[4])&(*pResult)[0]);
+      return MS::kSuccess;
+   }
+
+   // Mesh deformed whole: its raw float points are moved into the result
+   // buffer, then set in one call
+   std::vector<float> points;
+   std::vector<float> &xyzw = pResult ? *pResult : points;
+   xyzw.resize((size_t)uCount * 4);
+
+   const float *pRaw = fnOutput.getRawPoints();
+   for(unsigned int j = 0; j < uCount; j++)
+   {
+      xyzw[j*4]   = pRaw[j*3];
+      xyzw[j*4+1] = pRaw[j*3+1];
+      xyzw[j*4+2] = pRaw[j*3+2];
+      xyzw[j*4+3] = 1.0f;
+   }
+   for(size_t k = 0; k < weightMap.indices.size(); k++)
+   {
+      unsigned int j  = weightMap.indices[k];
+      float        wt = weightMap.values[j];
+      xyzw[j*4]   = (float)((double)pRaw[j*3]   + pDeltas->x[j] * wt);
+      xyzw[j*4+1] = (float)((double)pRaw[j*3+1] + pDeltas->y[j] * wt);
+      xyzw[j*4+2] = (float)((double)pRaw[j*3+2] + pDeltas->z[j] * wt);
+   }
+
+   fnOutput.setPoints(MFloatPointArray((const float (*)[4])&xyzw[0], uCount));
+   return MS::kSuccess;
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method gives the target stream the library items needed by the
+//      current frame and the streamWindow frames after the time attribute,
+//      nearest first. Weights driven by an anim curve directly are looked
+//      ahead on its samples, the others keep their current value. Once the
+//      stream evicted items, every kept delta that may refer to them is
+//      dropped.
+//
+void MorpheNode::StreamTargets(MDataBlock &data)
+{
+   if(mLibraryDirty)
+      OpenLibrary(data);
+
+   const MorpheActiveArray &active = GetActiveItems(data);
+   MTime now = data.inputValue(aTime).asTime();
+   if(now != mStreamTime || mActiveStamp != mStreamStamp)
+   {
+      MorpheStatsScope scope(mStats.fetchTime, "Stream window");
+      mStreamTime  = now;
+      mStreamStamp = mActiveStamp;
+
+      std::vector<unsigned int> window;
+      for(size_t a = 0; a < active.size(); a++)
+         window.push_back(active[a].item);
+
+      // Animated weights, read from the samples of their curves
+      std::vector<unsigned int>              curveWeights;
+      std::vector<const MorpheWeightCurve*>  curves;
+      for(std::map<unsigned int, MorpheWeightCurve>::const_iterator it = mWeightCurves.begin(); it != mWeightCurves.end(); it++)
+      {
+         if(it->first < mWeights.size() && !it->second.values.empty())
+         {
+            curveWeights.push_back(it->first);
+            curves.push_back(&it->second);
+         }
+      }
+
+      int iWindow = data.inputValue(aStreamWindow).asInt();
+      if(!curves.empty())
+      {
+         std::vector<float> frameWeights = mWeights;
+         MorpheActiveArray  frameActive;
+         for(int k = 1; k <= iWindow; k++)
+         {
+            MTime time = now + MTime((double)k, MTime::uiUnit());
+            for(size_t c = 0; c < curves.size(); c++)
+               frameWeights[curveWeights[c]] = curves[c]->Evaluate(time);
+
+            mWeightIndex.GetActive(frameWeights, frameActive);
+            for(size_t a = 0; a < frameActive.size(); a++)
+               window.push_back(frameActive[a].item);
+         }
+      }
+
+      // Only library items are streamed
+      std::vector<unsigned int> libraryWindow;
+      for(size_t w = 0; w < window.size(); w++)
+      {
+         if(mLibrary.Find(window[w]) >= 0)
+            libraryWindow.push_back(window[w]);
+      }
+
+      mStream.SetBudget((size_t)data.inputValue(aStreamBudget).asInt() << 20);
+      mStream.Update(libraryWindow);
+   }
+
+   if(mStream.Evictions() != mStreamEvictions)
+   {
+      mStreamEvictions = mStream.Evictions();
+      for(std::map<unsigned int, MorpheGeometryDeltas>::iterator it = mDeltas.begin(); it != mDeltas.end(); it++)
+      {
+         it->second.activeStamp = 0;
+         it->second.incremental.Reset();
+         it->second.basis.Clear();
+         it->second.tiles.Clear();
+      }
+   }
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method reads the painted weights of a geometry in one pass.
+//      Vertices without a weight element default to 1.
+//
+void MorpheNode::BuildWeightMap(MDataBlock &data, unsigned int mIndex, unsigned int uCount, MorpheWeightMap &weightMap)
+{
+   weightMap.Reset(uCount, 1.0f);
+
+   MArrayDataHandle hArrWeightList = data.inputArrayValue(weightList);
+   if(hArrWeightList.jumpToElement(mIndex) == MS::kSuccess)
+   {
+      MDataHandle      hWeightList = hArrWeightList.inputValue();
+      MArrayDataHandle hArrWeights(hWeightList.child(weights));
+
+      unsigned int uWeightCount = hArrWeights.elementCount();
+      for(unsigned int i = 0; i < uWeightCount; i++, hArrWeights.next())
+         weightMap.Set(hArrWeights.elementIndex(), hArrWeights.inputValue().asFloat());
+   }
+
+   weightMap.Finalize();
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method describes the inputs of an evaluation for the result cache:
+//      the geometry index, the input version, the point count, the
+//      envelope and every active item with its weight.
+//
+void MorpheNode::GetResultKey(MDataBlock &data, unsigned int mIndex, unsigned int uCount, float fEnv, std::vector<unsigned int> &key)
+{
+   const MorpheActiveArray &active = GetActiveItems(data);
+   mStats.activeItems = (unsigned int)active.size();
+
+   key.resize(4 + active.size() * 2);
+   key[0] = mIndex;
+   key[1] = mInputVersion;
+   key[2] = uCount;
+   memcpy(&key[3], &fEnv, sizeof(float));
+   for(size_t i = 0; i < active.size(); i++)
+   {
+      key[4 + 2*i] = active[i].item;
+      memcpy(&key[5 + 2*i], &active[i].weight, sizeof(float));
+   }
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method invalidates the cached targets whose inputs are being
+//      dirtied. Weight changes keep the cache untouched. Any other input
+//      may change the output points, so it drops the cached results.
+//
+// Return Values:
+//    MS::kSuccess
+//    MS::kFailure
+//
+MStatus MorpheNode::setDependentsDirty(const MPlug &plugBeingDirtied, MPlugArray &affectedPlugs)
+{
+   if(!(plugBeingDirtied == aWeight || plugBeingDirtied == envelope ||
+        plugBeingDirtied == aResultCacheBudget || plugBeingDirtied == aStreamWindow ||
+        plugBeingDirtied == aStreamBudget || plugBeingDirtied == aTime || plugBeingDirtied == outputGeom))
+   {
+      mInputVersion++;
+      mResultCache.Clear();
+   }
+
+   if(plugBeingDirtied == aMorpheGeometry || plugBeingDirtied == aMorphePoints || plugBeingDirtied == aMorpheComponents)
+   {
+      InvalidateTarget(plugBeingDirtied.parent().logicalIndex());
+   }
+   else if(plugBeingDirtied == aMorpheTargetWeights || plugBeingDirtied == aMorpheInbetween ||
+           plugBeingDirtied == aMorpheInbetweenWeight || plugBeingDirtied == aMorpheInbetweenGeometry ||
+           plugBeingDirtied == aMorpheInbetweenPoints || plugBeingDirtied == aMorpheInbetweenComponents)
+   {
+      int iItemIdx = GetItemIndex(plugBeingDirtied);
+      if(iItemIdx >= 0)
+         InvalidateTarget((unsigned int)iItemIdx);
+   }
+   else if(plugBeingDirtied == aMorpheWeights)
+   {
+      InvalidateTarget(plugBeingDirtied.parent().logicalIndex());
+      mWeightIndexDirty = true;
+   }
+   else if(plugBeingDirtied == aMorpheExpression)
+   {
+      mWeightIndexDirty = true;
+   }
+   else if(plugBeingDirtied == aMorpheItem)
+   {
+      if(plugBeingDirtied.isElement())
+         InvalidateTarget(plugBeingDirtied.logicalIndex());
+      else
+      {
+         mStream.Reset(&mLibrary);
+         mDeltas.clear();
+         mItems.clear();
+      }
+      mWeightIndexDirty = true;
+   }
+   else if(plugBeingDirtied == aCompression || plugBeingDirtied == aStreaming)
+   {
+      mStream.Reset(&mLibrary);
+      mDeltas.clear();
+      mItems.clear();
+   }
+   else if(plugBeingDirtied == aStreamWindow)
+   {
+      // Gathered again on the next evaluation
+      mStreamStamp = 0;
+   }
+   else if(plugBeingDirtied == aLibraryPath)
+   {
+      // Unmapped right away so the file can be rewritten
+      mStream.Reset(NULL);
+      mLibrary.Close();
+      mLibraryDirty = true;
+      mDeltas.clear();
+      mItems.clear();
+   }
+   else if(plugBeingDirtied == aIncremental || plugBeingDirtied == aBasis ||
+           plugBeingDirtied == aBasisTolerance || plugBeingDirtied == aBasisMaxShapes)
+   {
+      mDeltas.clear();
+   }
+   else if(plugBeingDirtied == weights)
+   {
+      MPlug plugWeights = plugBeingDirtied.isElement() ? plugBeingDirtied.array() : plugBeingDirtied;
+      mWeightMaps.erase(plugWeights.parent().logicalIndex());
+   }
+   else if(plugBeingDirtied == weightList)
+   {
+      if(plugBeingDirtied.isElement())
+         mWeightMaps.erase(plugBeingDirtied.logicalIndex());
+      else
+         mWeightMaps.clear();
+   }
+   else if(plugBeingDirtied == inputGeom)
+   {
+      // Deltas are relative to the input geometry of that index
+      mDeltas.erase(plugBeingDirtied.parent().logicalIndex());
+      mItems.erase(plugBeingDirtied.parent().logicalIndex());
+   }
+   else if(plugBeingDirtied == input)
+   {
+      if(plugBeingDirtied.isElement())
+      {
+         mDeltas.erase(plugBeingDirtied.logicalIndex());
+         mItems.erase(plugBeingDirtied.logicalIndex());
+      }
+      else
+      {
+         mDeltas.clear();
+         mItems.clear();
+      }
+   }
+
+   return MPxDeformerNode::setDependentsDirty(plugBeingDirtied, affectedPlugs);
+}
 // -----------------------------------------------------------------------------
 
 
-MTypeId MorpheNode::id(MORPHE_ID);
+//
+// Description:
+//    This method samples the anim curve driving a weight, which the stream
+//      looks ahead on, so that deform neither walks the connections nor
+//      evaluates the curve.
+//
+// Return Values:
+//    MS::kSuccess
+//    MS::kFailure
+//
+MStatus MorpheNode::connectionMade(const MPlug &plug, const MPlug &otherPlug, bool asSrc)
+{
+   if(!asSrc && plug == aWeight && plug.isElement() && otherPlug.node().hasFn(MFn::kAnimCurve))
+   {
+      MorpheWeightCurve &weightCurve = mWeightCurves[plug.logicalIndex()];
+      weightCurve.curve = otherPlug.node();
+      SampleWeightCurve(weightCurve);
+      mStreamStamp = 0;
+   }
+
+   return MPxDeformerNode::connectionMade(plug, otherPlug, asSrc);
+}
 // -----------------------------------------------------------------------------
 
 
 //
-// Attributes
+// Description:
+//    This method forgets the anim curve of a disconnected weight.
 //
-MObject MorpheNode::aWeight;
-MObject MorpheNode::aMorpheItem;
-MObject MorpheNode::aMorpheName;
-MObject MorpheNode::aMorpheWeights;
-MObject MorpheNode::aMorpheGeometry;
-MObject MorpheNode::aMorphePoints;
-MObject MorpheNode::aMorpheComponents;
+// Return Values:
+//    MS::kSuccess
+//    MS::kFailure
+//
+MStatus MorpheNode::connectionBroken(const MPlug &plug, const MPlug &otherPlug, bool asSrc)
+{
+   if(!asSrc && plug == aWeight && plug.isElement())
+   {
+      mWeightCurves.erase(plug.logicalIndex());
+      mStreamStamp = 0;
+   }
+
+   return MPxDeformerNode::connectionBroken(plug, otherPlug, asSrc);
+}
 // -----------------------------------------------------------------------------
 
 
 //
-// Constructor
+// Description:
+//    This method samples an anim curve every frame from its first to its
+//      last key. It evaluates the curve, so it is only called outside of
+//      compute.
+//
+void MorpheNode::SampleWeightCurve(MorpheWeightCurve &weightCurve)
+{
+   MFnAnimCurve fnCurve(weightCurve.curve);
+   unsigned int uKeyCount = fnCurve.numKeys();
+   weightCurve.values.clear();
+   if(uKeyCount == 0)
+      return;
+
+   MTime  first = fnCurve.time(0);
+   double dLast = fnCurve.time(uKeyCount - 1).as(MTime::kSeconds);
+   weightCurve.start = first.as(MTime::kSeconds);
+   weightCurve.step  = MTime(1.0, MTime::uiUnit()).as(MTime::kSeconds);
+
+   double dCount = ceil((dLast - weightCurve.start) / weightCurve.step);
+   unsigned int uCount = (unsigned int)std::min(dCount, (double)MORPHE_CURVE_SAMPLES) + 1;
+   weightCurve.values.resize(uCount);
+   for(unsigned int k = 0; k < uCount; k++)
+      weightCurve.values[k] = (float)fnCurve.evaluate(first + MTime((double)k, MTime::uiUnit()));
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method samples again the edited curves that drive weights of the
+//      node given as pData.
 //
-MorpheNode::MorpheNode() {}
+void MorpheNode::AnimCurveEdited(MObjectArray &editedCurves, void *pData)
+{
+   MorpheNode *pNode = (MorpheNode*)pData;
+   for(std::map<unsigned int, MorpheWeightCurve>::iterator it = pNode->mWeightCurves.begin(); it != pNode->mWeightCurves.end(); it++)
+   {
+      for(unsigned int i = 0; i < editedCurves.length(); i++)
+      {
+         if(editedCurves[i] == it->second.curve)
+         {
+            SampleWeightCurve(it->second);
+            pNode->mStreamStamp = 0;
+            break;
+         }
+      }
+   }
+}
 // -----------------------------------------------------------------------------
 
 
 //
-// Destructor
+// Description:
+//    This method returns the sample nearest to a time.
 //
-MorpheNode::~MorpheNode() {}
+float MorpheWeightCurve::Evaluate(const MTime &time) const
+{
+   double dSample = floor((time.as(MTime::kSeconds) - start) / step + 0.5);
+   if(dSample <= 0.0)
+      return values.front();
+   if(dSample >= (double)(values.size() - 1))
+      return values.back();
+   return values[(size_t)dSample];
+}
 // -----------------------------------------------------------------------------
 
 
 //
 // Description:
-//    This method gets weights for each target item.
+//    This method finds the morpheItem element a plug belongs to.
 //
 // Return Values:
-//    MS::kSuccess
-//    MS::kFailure
+//    the item logical index, -1 if the plug is not under an item
 //
-MStatus MorpheNode::GetWeights(MDataBlock &data, MFnIntArrayData &ids, float &wt)
+int MorpheNode::GetItemIndex(const MPlug &plug)
 {
-   // Get array of weights
-   MArrayDataHandle hArrWeight = data.inputArrayValue(aWeight);
-
-   // If no weights, exit
-   unsigned int uWeightCount = hArrWeight.elementCount();
-   if (uWeightCount == 0)
+   MPlug plugUp = plug;
+   while(!plugUp.isNull())
    {
-      wt = 0.0;
-      return MS::kSuccess;
+      if(plugUp.isElement())
+      {
+         if(plugUp == aMorpheItem)
+            return (int)plugUp.logicalIndex();
+         plugUp = plugUp.array();
+      }
+      else if(plugUp.isChild())
+      {
+         plugUp = plugUp.parent();
+      }
+      else
+      {
+         break;
+      }
    }
+   return -1;
+}
+// -----------------------------------------------------------------------------
 
-   // If no Id weights, exit
-   unsigned int uWeightIdsCount = ids.length();
-   if (uWeightIdsCount == 0)
-   {
-      wt = 0.0;
-      return MS::kSuccess;
-   }
 
-   hArrWeight.jumpToArrayElement(ids[0]);
-   wt = hArrWeight.inputValue().asFloat();
+//
+// Description:
+//    This method drops the cached item on every geometry, along with the
+//      combination items relative to it, and the kept deltas. A streamed
+//      item is loaded again on its next use.
+//
+void MorpheNode::InvalidateTarget(unsigned int uItemIdx)
+{
+   mDeltas.clear();
+   mStream.Drop(uItemIdx);
 
-   for(unsigned int i = 1; i < uWeightIdsCount; i++)
+   std::map<unsigned int, MorpheItemMap>::iterator itGeo;
+   for(itGeo = mItems.begin(); itGeo != mItems.end(); itGeo++)
    {
-      hArrWeight.jumpToArrayElement(ids[i]);
-      wt *= hArrWeight.inputValue().asFloat();
+      MorpheItemMap &items = itGeo->second;
+      MorpheItemMap::iterator itItem = items.find(uItemIdx);
+
+      MorpheItem dirty;
+      bool bKnown = itItem != items.end();
+      if(bKnown)
+      {
+         dirty.weightIds.swap(itItem->second.weightIds);
+         items.erase(itItem);
+      }
+
+      // Without its weights every combination may depend on it
+      for(itItem = items.begin(); itItem != items.end();)
+      {
+         if(itItem->second.IsCombination() && (!bKnown || itItem->second.DependsOn(dirty)))
+            items.erase(itItem++);
+         else
+            itItem++;
+      }
    }
-   return MS::kSuccess;
 }
 // -----------------------------------------------------------------------------
 
 
 //
 // Description:
-//    This method gets the final deltas position for each vertex.
+//    This method returns how many target lookups were served from the cache
+//      and how many had to rebuild the target.
 //
-// Return Values:
-//    MS::kSuccess
-//    MS::kFailure
+void MorpheNode::GetCacheStats(unsigned int &uHits, unsigned int &uMisses) const
+{
+   uHits   = mCacheHits;
+   uMisses = mCacheMisses;
+}
+// -----------------------------------------------------------------------------
+
+
 //
-MStatus MorpheNode::GetTargetsDeltas(MDataBlock &data, MItGeometry &itGeo, float &fEnv, MPointArray &deltas)
+// Description:
+//    This method returns how many evaluations were served from the result
+//      cache and how many were computed, then the results it holds and their
+//      memory.
+//
+void MorpheNode::GetResultCacheStats(unsigned int &uHits, unsigned int &uMisses, unsigned int &uCount, size_t &uSize) const
 {
-   MStatus status;
-   MPointArray targetPts;
+   uHits   = mResultCache.Hits();
+   uMisses = mResultCache.Misses();
+   uCount  = mResultCache.Count();
+   uSize   = mResultCache.MemorySize();
+}
+// -----------------------------------------------------------------------------
 
-   // Get original deltas
-   MPointArray deltasOrig;
-   itGeo.allPositions(deltasOrig);
 
-   // Get array of morphes
-   MArrayDataHandle hArrMorpheItem = data.inputArrayValue(aMorpheItem, &status);
-   if (status != MS::kSuccess)
-      return MS::kSuccess;
+//
+// Description:
+//    This method returns the library items the stream holds and their
+//      memory, then how many were loaded on use, prefetched and evicted.
+//
+void MorpheNode::GetStreamStats(unsigned int &uResident, size_t &uSize, unsigned int &uLoads, unsigned int &uPrefetches, unsigned int &uEvictions) const
+{
+   uResident   = mStream.ResidentCount();
+   uSize       = mStream.MemorySize();
+   uLoads      = mStream.Loads();
+   uPrefetches = mStream.Prefetches();
+   uEvictions  = mStream.Evictions();
+}
+// -----------------------------------------------------------------------------
 
-   unsigned int targetArrayCount = hArrMorpheItem.elementCount();
-   if (targetArrayCount == 0)
-      return MS::kSuccess;
 
-   // Go through each target
-   unsigned int uItemIdx = 0;
-   float wt;
-   for(unsigned int i = 0; i < targetArrayCount; i++)
-   {
-      uItemIdx = hArrMorpheItem.elementIndex(); // Index Item
+//
+// Description:
+//    This method returns the evaluation counters.
+//
+void MorpheNode::GetStats(MorpheStats &stats) const
+{
+   stats = mStats;
+}
+// -----------------------------------------------------------------------------
 
-      MDataHandle hMorpheItem = hArrMorpheItem.inputValue(); // Get compound element Item
 
-      // Get Weights
-      MObject oMorpheWeights = hMorpheItem.child(aMorpheWeights).data();
-      MFnIntArrayData arrMorpheWeightsIds(oMorpheWeights);
-      GetWeights(data, arrMorpheWeightsIds, wt);
+//
+// Description:
+//    This method clears the evaluation and cache counters.
+//
+void MorpheNode::ResetStats()
+{
+   mStats.evaluations     = 0;
+   mStats.gatherTime      = 0.0;
+   mStats.fetchTime       = 0.0;
+   mStats.accumulateTime  = 0.0;
+   mStats.writeTime       = 0.0;
+   mStats.activeItems     = 0;
+   mStats.terms           = 0;
+   mStats.verticesTouched = 0;
+   mCacheHits             = 0;
+   mCacheMisses           = 0;
+   mResultCache.ResetStats();
+}
+// -----------------------------------------------------------------------------
+
 
-      if(wt != 0.0)
+//
+// Description:
+//    This method returns the largest error of the quantized targets built so
+//      far, 0 when compression is off.
+//
+float MorpheNode::GetQuantizeError() const
+{
+   float fError = 0.0f;
+   for(std::map<unsigned int, MorpheItemMap>::const_iterator itGeo = mItems.begin(); itGeo != mItems.end(); itGeo++)
+   {
+      for(MorpheItemMap::const_iterator it = itGeo->second.begin(); it != itGeo->second.end(); it++)
       {
-         MObject oMorpheGeometry = hMorpheItem.child(aMorpheGeometry).asMesh();
-         if(oMorpheGeometry.isNull())
-         {
-            return MS::kSuccess;
-         }
-         else
-         {
-            MFnMesh fnMorpheGeometry(oMorpheGeometry);
-            fnMorpheGeometry.getPoints(targetPts);
-
-            wt = wt * fEnv;
-
-            for(unsigned int j = 0; j < targetPts.length(); j++)
-            {
-               if(arrMorpheWeightsIds.length() == 1)
-                  deltas.set(deltas[j] + (targetPts[j] - deltasOrig[j]) * wt, j);
-               else
-                  deltas.set(deltas[j] + (targetPts[j] - deltasOrig[j]) * wt, j);    // TODO
-            }
-         }
-      }   
-      targetPts.clear();
-      hArrMorpheItem.next();
+         float fItemError = it->second.QuantizeError();
+         if(fItemError > fError)
+            fError = fItemError;
+      }
    }
-
-   return MS::kSuccess;
+   return fError;
 }
 // -----------------------------------------------------------------------------
 
 
 //
 // Description:
-//    This method performs the deformation algorithm. A status code of
-//      MS::kSuccess should be returned unless there was a problem during
-//      the deformation, such as insufficient memory or required input
-//      data is missing or invalid.
+//    This method returns the error of the basis of the first geometry for
+//      every shape count, from 0 to all of its targets, and the shape count
+//      in use.
 //
 // Return Values:
-//    MS::kSuccess
-//    MS::kFailure
+//    false if no basis was built yet
 //
-MStatus MorpheNode::deform(MDataBlock &data, MItGeometry &itGeo, const MMatrix &localToWorldMatrix, unsigned int mIndex)
+bool MorpheNode::GetBasisErrors(std::vector<float> &errors, unsigned int &uShapeCount) const
 {
-   MStatus status;
+   errors.clear();
+   uShapeCount = 0;
+   for(std::map<unsigned int, MorpheGeometryDeltas>::const_iterator it = mDeltas.begin(); it != mDeltas.end(); it++)
+   {
+      const MorpheBasis &basis = it->second.basis;
+      if(!basis.IsBuilt())
+         continue;
 
-   // Check Node State
-   MDataHandle hNodeState = data.inputValue(state, &status);
-   int nNodeState = hNodeState.asShort() ;
-   if (nNodeState == 1)
-      return MS::kSuccess;
+      for(unsigned int k = 0; k <= basis.TargetCount(); k++)
+         errors.push_back(basis.Error(k));
+      uShapeCount = basis.ShapeCount();
+      return true;
+   }
+   return false;
+}
+// -----------------------------------------------------------------------------
 
-   // Envelope data from the base class
-   // The envelope is simply a scale factor
-   MDataHandle hEnvelope = data.inputValue(envelope, &status);
-   float fEnv = hEnvelope.asFloat();
-   if(fEnv <= 0.0) // If off... done!
-      return MS::kSuccess;
 
-   // Get Targets
-   MPointArray deltas(itGeo.count());
-   GetTargetsDeltas(data, itGeo, fEnv, deltas);
+//
+// Description:
+//    This method runs every task in a Maya parallel region and waits for
+//      them to finish.
+//
+void MorpheMayaParallel::Run(unsigned int uTaskCount, MorpheTaskFunc func, void *pData)
+{
+   if(uTaskCount < 2)
+   {
+      for(unsigned int t = 0; t < uTaskCount; t++)
+         func(pData, t);
+      return;
+   }
 
-   // Iterate through each point in the geometry
-   MPoint   ptOrig;
-   MPoint   ptDef;
-   float    wt = 0.0f;
+   std::vector<Task> tasks(uTaskCount);
+   for(unsigned int t = 0; t < uTaskCount; t++)
+   {
+      tasks[t].func  = func;
+      tasks[t].data  = pData;
+      tasks[t].index = t;
+   }
 
-   for(itGeo.reset(); !itGeo.isDone(); itGeo.next())
+   if(MThreadPool::newParallelRegion(CreateTasks, &tasks) != MS::kSuccess)
    {
-      // Get weight values for this point
-      wt = weightValue(data, mIndex, itGeo.index());
-      if(wt <= 0.0) // If this pt isn't affected at all, just ignore it.
-         continue;
+      // Thread pool unavailable, run serially
+      for(unsigned int t = 0; t < uTaskCount; t++)
+         func(pData, t);
+   }
+}
+// -----------------------------------------------------------------------------
 
-      ptOrig = itGeo.position();
 
-      ptDef = ptOrig + (deltas[itGeo.index()] * wt);
-      itGeo.setPosition(ptDef);
-   }
+//
+// Description:
+//    This method queues one Maya task per core task.
+//
+void MorpheMayaParallel::CreateTasks(void *pData, MThreadRootTask *pRoot)
+{
+   std::vector<Task> &tasks = *(std::vector<Task>*)pData;
+   for(size_t t = 0; t < tasks.size(); t++)
+      MThreadPool::createTask(RunTask, &tasks[t], pRoot);
+   MThreadPool::executeAndJoin(pRoot);
+}
+// -----------------------------------------------------------------------------
 
-   return MS::kSuccess;
+
+//
+// Description:
+//    This method runs a single core task on a Maya worker thread.
+//
+MThreadRetVal MorpheMayaParallel::RunTask(void *pData)
+{
+   Task *pTask = (Task*)pData;
+   pTask->func(pTask->data, pTask->index);
+   return 0;
 }
 // -----------------------------------------------------------------------------
 
@@ -240,6 +1617,8 @@ MStatus MorpheNode::initialize()
    MFnNumericAttribute  nAttr;
    MFnTypedAttribute    tAttr;
    MFnCompoundAttribute cAttr;
+   MFnEnumAttribute     eAttr;
+   MFnUnitAttribute     uAttr;
 
    aWeight = nAttr.create("weight", "wt", MFnNumericData::kFloat, 0.0);
    nAttr.setArray(true);
@@ -250,6 +1629,64 @@ MStatus MorpheNode::initialize()
    nAttr.setSoftMin(0.0);
    nAttr.setSoftMax(1.0);
 
+   aCompression = eAttr.create("compression", "cmp", MORPHE_COMPRESSION_NONE);
+   eAttr.addField("none", MORPHE_COMPRESSION_NONE);
+   eAttr.addField("quantized16", MORPHE_COMPRESSION_QUANTIZED);
+   eAttr.setStorable(true);
+   eAttr.setKeyable(false);
+
+   aLibraryPath = tAttr.create("libraryPath", "lib", MFnData::kString);
+   tAttr.setStorable(true);
+   tAttr.setConnectable(false);
+
+   aIncremental = nAttr.create("incremental", "inc", MFnNumericData::kBoolean, false);
+   nAttr.setStorable(true);
+   nAttr.setKeyable(false);
+
+   aBasis = nAttr.create("basis", "bas", MFnNumericData::kBoolean, false);
+   nAttr.setStorable(true);
+   nAttr.setKeyable(false);
+
+   aBasisTolerance = nAttr.create("basisTolerance", "bto", MFnNumericData::kFloat, 0.001);
+   nAttr.setStorable(true);
+   nAttr.setKeyable(false);
+   nAttr.setMin(0.0);
+   nAttr.setSoftMax(0.1);
+
+   aBasisMaxShapes = nAttr.create("basisMaxShapes", "bms", MFnNumericData::kInt, 0);
+   nAttr.setStorable(true);
+   nAttr.setKeyable(false);
+   nAttr.setMin(0);
+
+   aResultCache = nAttr.create("resultCache", "rc", MFnNumericData::kBoolean, false);
+   nAttr.setStorable(true);
+   nAttr.setKeyable(false);
+
+   aResultCacheBudget = nAttr.create("resultCacheBudget", "rcb", MFnNumericData::kInt, 256);
+   nAttr.setStorable(true);
+   nAttr.setKeyable(false);
+   nAttr.setMin(0);
+
+   aStreaming = nAttr.create("streaming", "str", MFnNumericData::kBoolean, false);
+   nAttr.setStorable(true);
+   nAttr.setKeyable(false);
+
+   // Frames looked ahead from time. Only weights driven directly by an anim
+   // curve are sampled ahead, the others keep their current value.
+   aStreamWindow = nAttr.create("streamWindow", "swn", MFnNumericData::kInt, 24);
+   nAttr.setStorable(true);
+   nAttr.setKeyable(false);
+   nAttr.setMin(0);
+
+   aStreamBudget = nAttr.create("streamBudget", "sbu", MFnNumericData::kInt, 1024);
+   nAttr.setStorable(true);
+   nAttr.setKeyable(false);
+   nAttr.setMin(0);
+
+   aTime = uAttr.create("time", "tim", MFnUnitAttribute::kTime, 0.0);
+   uAttr.setStorable(true);
+   uAttr.setKeyable(false);
+
    aMorpheName = tAttr.create("morpheName", "itn", MFnData::kString);
    tAttr.setStorable(true);
    tAttr.setConnectable(false);
@@ -270,6 +1707,46 @@ MStatus MorpheNode::initialize()
    nAttr.setStorable(true);
    nAttr.setConnectable(false);
 
+   aMorpheExpression = tAttr.create("morpheExpression", "ite", MFnData::kString);
+   tAttr.setStorable(true);
+   tAttr.setConnectable(false);
+
+   aMorpheTargetWeights = nAttr.create("morpheTargetWeights", "itwm", MFnNumericData::kFloat, 1.0);
+   nAttr.setArray(true);
+   nAttr.setUsesArrayDataBuilder(true);
+   nAttr.setStorable(true);
+   nAttr.setConnectable(true);
+   nAttr.setMin(0.0);
+   nAttr.setMax(1.0);
+
+   aMorpheInbetweenWeight = nAttr.create("morpheInbetweenWeight", "ibw", MFnNumericData::kFloat, 0.5);
+   nAttr.setStorable(true);
+   nAttr.setConnectable(false);
+   nAttr.setMin(0.0);
+   nAttr.setMax(1.0);
+
+   aMorpheInbetweenGeometry = tAttr.create("morpheInbetweenGeometry", "ibg", MFnData::kMesh);
+   tAttr.setStorable(false);
+   tAttr.setConnectable(true);
+
+   aMorpheInbetweenPoints = tAttr.create("morpheInbetweenPoints", "ibp", MFnData::kPointArray);
+   tAttr.setStorable(true);
+   tAttr.setConnectable(true);
+
+   aMorpheInbetweenComponents = tAttr.create("morpheInbetweenComponents", "ibc", MFnData::kComponentList);
+   tAttr.setStorable(true);
+   tAttr.setConnectable(true);
+
+   aMorpheInbetween = cAttr.create("morpheInbetween", "itib");
+   cAttr.setArray(true);
+   cAttr.setUsesArrayDataBuilder(true);
+   cAttr.setStorable(true);
+   cAttr.setConnectable(true);
+   cAttr.addChild(aMorpheInbetweenWeight);
+   cAttr.addChild(aMorpheInbetweenGeometry);
+   cAttr.addChild(aMorpheInbetweenPoints);
+   cAttr.addChild(aMorpheInbetweenComponents);
+
    aMorpheItem = cAttr.create("morpheItem", "iti");
    cAttr.setArray(true);
    cAttr.setUsesArrayDataBuilder(true);
@@ -280,19 +1757,51 @@ MStatus MorpheNode::initialize()
    cAttr.addChild(aMorphePoints);
    cAttr.addChild(aMorpheComponents);
    cAttr.addChild(aMorpheWeights);
+   cAttr.addChild(aMorpheExpression);
+   cAttr.addChild(aMorpheTargetWeights);
+   cAttr.addChild(aMorpheInbetween);
 
    addAttribute(aWeight);
+   addAttribute(aCompression);
+   addAttribute(aLibraryPath);
+   addAttribute(aIncremental);
+   addAttribute(aBasis);
+   addAttribute(aBasisTolerance);
+   addAttribute(aBasisMaxShapes);
+   addAttribute(aResultCache);
+   addAttribute(aResultCacheBudget);
+   addAttribute(aStreaming);
+   addAttribute(aStreamWindow);
+   addAttribute(aStreamBudget);
+   addAttribute(aTime);
    addAttribute(aMorpheItem);
 
    attributeAffects(aWeight, outputGeom);
+   attributeAffects(aCompression, outputGeom);
+   attributeAffects(aLibraryPath, outputGeom);
+   attributeAffects(aIncremental, outputGeom);
+   attributeAffects(aBasis, outputGeom);
+   attributeAffects(aBasisTolerance, outputGeom);
+   attributeAffects(aBasisMaxShapes, outputGeom);
+   attributeAffects(aResultCache, outputGeom);
+   attributeAffects(aStreaming, outputGeom);
+   attributeAffects(aTime, outputGeom);
    attributeAffects(aMorpheItem, outputGeom);
    attributeAffects(aMorpheGeometry, outputGeom);
    attributeAffects(aMorphePoints, outputGeom);
    attributeAffects(aMorpheComponents, outputGeom);
    attributeAffects(aMorpheWeights, outputGeom);
+   attributeAffects(aMorpheExpression, outputGeom);
+   attributeAffects(aMorpheTargetWeights, outputGeom);
+   attributeAffects(aMorpheInbetween, outputGeom);
+   attributeAffects(aMorpheInbetweenWeight, outputGeom);
+   attributeAffects(aMorpheInbetweenGeometry, outputGeom);
+   attributeAffects(aMorpheInbetweenPoints, outputGeom);
+   attributeAffects(aMorpheInbetweenComponents, outputGeom);
 
    // Make the deformer weights paintable
    MGlobal::executeCommand( "makePaintable -attrType multiFloat -sm deformer morphe weights;" );
+   MGlobal::executeCommand( "makePaintable -attrType multiFloat -sm deformer morphe morpheTargetWeights;" );
 
    return MS::kSuccess;
 }
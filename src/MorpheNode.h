@@ -6,25 +6,141 @@
 #define MORPHE_NODE_H
 #define MORPHE_ID          0x32000001
 
+// compression attribute values
+#define MORPHE_COMPRESSION_NONE        0
+#define MORPHE_COMPRESSION_QUANTIZED   1
+
+// Most frames sampled on an anim curve driving a weight
+#define MORPHE_CURVE_SAMPLES           100000
 
 //
 // Includes
 //
+#include <maya/MAnimMessage.h>
+#include <maya/MArrayDataHandle.h>
 #include <maya/MDataBlock.h>
 #include <maya/MDataHandle.h>
 #include <maya/MFloatArray.h>
+#include <maya/MFloatPointArray.h>
+#include <maya/MFnAnimCurve.h>
+#include <maya/MFnComponentListData.h>
 #include <maya/MFnCompoundAttribute.h>
+#include <maya/MFnEnumAttribute.h>
 #include <maya/MFnMesh.h>
 #include <maya/MFnIntArrayData.h>
 #include <maya/MFnNumericAttribute.h>
+#include <maya/MFnPointArrayData.h>
+#include <maya/MFnSingleIndexedComponent.h>
 #include <maya/MFnTypedAttribute.h>
+#include <maya/MFnUnitAttribute.h>
 #include <maya/MGlobal.h>
+#include <maya/MIntArray.h>
 #include <maya/MItGeometry.h>
+#include <maya/MMessage.h>
 #include <maya/MMatrix.h>
+#include <maya/MObjectArray.h>
 #include <maya/MPlug.h>
+#include <maya/MPlugArray.h>
 #include <maya/MPointArray.h>
+#include <maya/MProfiler.h>
 #include <maya/MPxDeformerNode.h>
+#include <maya/MThreadPool.h>
+#include <maya/MTime.h>
+#include <maya/MTimer.h>
 #include <maya/MTypeId.h>
+#include <maya/MVector.h>
+
+#include "core/MorpheAccumulator.h"
+#include "core/MorpheBasis.h"
+#include "core/MorpheIncremental.h"
+#include "core/MorpheItem.h"
+#include "core/MorpheItemStream.h"
+#include "core/MorpheLibrary.h"
+#include "core/MorpheResultCache.h"
+#include "core/MorpheTiles.h"
+#include "core/MorpheWeightIndex.h"
+#include "core/MorpheWeightMap.h"
+
+#include <map>
+#include <vector>
+// -----------------------------------------------------------------------------
+
+
+//
+// MorpheMayaParallel - Runs core tasks on Maya's thread pool
+//
+class MorpheMayaParallel : public MorpheParallel
+{
+   public:
+      virtual void            Run(unsigned int uTaskCount, MorpheTaskFunc func, void *pData);
+
+   private:
+      struct Task
+      {
+         MorpheTaskFunc       func;
+         void                 *data;
+         unsigned int         index;
+      };
+
+      static  MThreadRetVal   RunTask(void *pData);
+      static  void            CreateTasks(void *pData, MThreadRootTask *pRoot);
+};
+// -----------------------------------------------------------------------------
+
+
+//
+// MorpheStats - Evaluation counters of a node, see morphe -q -stats. Times
+//    are totals in seconds, counts are from the last evaluation.
+//
+struct MorpheStats
+{
+   unsigned int   evaluations;
+   double         gatherTime;       // Painted weights, weights and active items
+   double         fetchTime;        // Building items on cache misses
+   double         accumulateTime;
+   double         writeTime;        // Moving and writing back the points
+   unsigned int   activeItems;
+   unsigned int   terms;            // Shapes accumulated
+   unsigned int   verticesTouched;
+};
+// -----------------------------------------------------------------------------
+
+
+//
+// MorpheGeometryDeltas - Deltas of one deformed geometry kept between
+//    evaluations. They refer to the cached items of the geometry and are
+//    dropped along with them.
+//
+struct MorpheGeometryDeltas
+{
+   MorpheGeometryDeltas() : activeStamp(0), envelope(0.0f), termCount(0) {}
+
+   MorpheDeltas         deltas;           // Accumulated from scratch
+   unsigned int         activeStamp;      // Active set they are for, 0 if none
+   float                envelope;
+   unsigned int         termCount;
+   MorpheIncremental    incremental;      // Kept deltas of the incremental mode
+   MorpheBasis          basis;            // Principal shapes of the basis mode
+   MorpheTiles          tiles;            // Tile spans of the cached targets
+};
+// -----------------------------------------------------------------------------
+
+
+//
+// MorpheWeightCurve - Anim curve driving a weight, sampled every frame from
+//    its first to its last key when it is connected or edited, so that the
+//    stream looks ahead without evaluating another node inside deform.
+//    Values are held before the first key and after the last.
+//
+struct MorpheWeightCurve
+{
+   MObject              curve;
+   double               start;            // Seconds of the first sample
+   double               step;             // Seconds between samples
+   std::vector<float>   values;
+
+   float                Evaluate(const MTime &time) const;
+};
 // -----------------------------------------------------------------------------
 
 
@@ -37,9 +153,45 @@ class MorpheNode : public MPxDeformerNode
                         MorpheNode();
       virtual           ~MorpheNode(); 
    
-      static  MStatus   GetWeights(MDataBlock &data, MFnIntArrayData &ids, float &wt);
-      static  MStatus   GetTargetsDeltas(MDataBlock &data, MItGeometry &itGeo, float &fEnv, MPointArray &deltas);
+      static  MStatus   GetWeights(MDataBlock &data, std::vector<float> &weights);
+              void      BuildWeightIndex(MDataBlock &data);
+              const MorpheActiveArray &GetActiveItems(MDataBlock &data);
+      static  void      GetFloatPoints(const MPointArray &pts, std::vector<float> &xyz);
+      static  unsigned int GetMeshPoints(const MObject &oMesh, std::vector<float> &xyz);
+      static  bool      GetOutputMesh(MDataBlock &data, unsigned int mIndex, unsigned int uCount, MFnMesh &fnMesh);
+      static  bool      GetBakedTarget(const MObject &oPoints, const MObject &oComponents, std::vector<int> &components, std::vector<float> &deltas);
+      static  void      GetTargetWeights(MDataHandle &hMorpheItem, std::vector<unsigned int> &indices, std::vector<float> &values);
+      static  void      GetTargetWeights(const MPlug &plugItem, std::vector<unsigned int> &indices, std::vector<float> &values);
+      static  bool      BuildTarget(MObject oMesh, const MObject &oPoints, const MObject &oComponents, MItGeometry &itGeo, const MObject &oBase, std::vector<float> &origXYZ, MorpheTarget &target, bool &bLive);
+              bool      BuildItem(MDataHandle &hMorpheItem, unsigned int uItemIdx, MItGeometry &itGeo, std::vector<float> &origXYZ, const std::vector<const MorpheItem*> &parents, MorpheItem &item);
+      static  void      ApplyTargetWeights(MDataHandle &hMorpheItem, MorpheItem &item);
+              void      OpenLibrary(MDataBlock &data);
+              MorpheItem* FetchItem(MArrayDataHandle &hArrMorpheItem, MItGeometry &itGeo, unsigned int mIndex, unsigned int uItemIdx, unsigned int uVertexCount, bool bQuantize, bool bStream, std::vector<float> &origXYZ);
+              void      BuildBasis(MDataBlock &data, MItGeometry &itGeo, unsigned int mIndex, unsigned int uVertexCount, MorpheBasis &basis);
+              MStatus   GetTerms(MDataBlock &data, MItGeometry &itGeo, unsigned int mIndex, unsigned int uVertexCount, const MorpheActiveArray &active, float fEnv, std::vector<float> &origXYZ, MorpheTermArray &terms);
+              MStatus   GetTargetsDeltas(MDataBlock &data, MItGeometry &itGeo, unsigned int mIndex, unsigned int uVertexCount, float fEnv, MorpheGeometryDeltas &geoDeltas);
+              MStatus   GetIncrementalDeltas(MDataBlock &data, MItGeometry &itGeo, unsigned int mIndex, unsigned int uVertexCount, float fEnv, MorpheIncremental &incremental);
+              void      StreamTargets(MDataBlock &data);
+              void      BuildWeightMap(MDataBlock &data, unsigned int mIndex, unsigned int uCount, MorpheWeightMap &weightMap);
+              void      GetResultKey(MDataBlock &data, unsigned int mIndex, unsigned int uCount, float fEnv, std::vector<unsigned int> &key);
+              MStatus   EvaluateFrames(const std::vector< std::vector<float> > &frameWeights, const std::vector<float> &frameEnvelopes, std::vector<MorpheDeltas> &frameDeltas, MorpheWeightMap &weightMap);
       virtual MStatus   deform(MDataBlock &data, MItGeometry &itGeo, const MMatrix &localToWorldMatrix, unsigned int mIndex);
+      virtual MStatus   setDependentsDirty(const MPlug &plugBeingDirtied, MPlugArray &affectedPlugs);
+      virtual MStatus   connectionMade(const MPlug &plug, const MPlug &otherPlug, bool asSrc);
+      virtual MStatus   connectionBroken(const MPlug &plug, const MPlug &otherPlug, bool asSrc);
+      virtual void      postConstructor();
+      static  void      SampleWeightCurve(MorpheWeightCurve &weightCurve);
+      static  void      AnimCurveEdited(MObjectArray &editedCurves, void *pData);
+
+      static  int       GetItemIndex(const MPlug &plug);
+              void      InvalidateTarget(unsigned int uItemIdx);
+              void      GetCacheStats(unsigned int &uHits, unsigned int &uMisses) const;
+              void      GetResultCacheStats(unsigned int &uHits, unsigned int &uMisses, unsigned int &uCount, size_t &uSize) const;
+              void      GetStreamStats(unsigned int &uResident, size_t &uSize, unsigned int &uLoads, unsigned int &uPrefetches, unsigned int &uEvictions) const;
+              float     GetQuantizeError() const;
+              bool      GetBasisErrors(std::vector<float> &errors, unsigned int &uShapeCount) const;
+              void      GetStats(MorpheStats &stats) const;
+              void      ResetStats();
    
       static  void*     creator();
       static  MStatus   initialize();
@@ -53,7 +205,22 @@ class MorpheNode : public MPxDeformerNode
       static MTypeId id;
    
       // Input Attributes
+      // Maya profiler category of the deform phases
+      static int     profilerCategory;
+
       static MObject aWeight;
+      static MObject aCompression;
+      static MObject aLibraryPath;
+      static MObject aIncremental;
+      static MObject aBasis;
+      static MObject aBasisTolerance;
+      static MObject aBasisMaxShapes;
+      static MObject aResultCache;
+      static MObject aResultCacheBudget;
+      static MObject aStreaming;
+      static MObject aStreamWindow;
+      static MObject aStreamBudget;
+      static MObject aTime;
    
       static MObject aMorpheItem;
       static MObject aMorpheName;
@@ -61,6 +228,72 @@ class MorpheNode : public MPxDeformerNode
       static MObject aMorphePoints;
       static MObject aMorpheComponents;
       static MObject aMorpheWeights;
+      static MObject aMorpheExpression;
+      static MObject aMorpheTargetWeights;
+      static MObject aMorpheInbetween;
+      static MObject aMorpheInbetweenWeight;
+      static MObject aMorpheInbetweenGeometry;
+      static MObject aMorpheInbetweenPoints;
+      static MObject aMorpheInbetweenComponents;
+
+   private:
+
+      // Sparse items, per deformed geometry index
+      std::map<unsigned int, MorpheItemMap> mItems;
+
+      // Painted deformer weights, per deformed geometry index
+      std::map<unsigned int, MorpheWeightMap> mWeightMaps;
+
+      // Items reachable from each weight id, rebuilt when morpheWeights or
+      // morpheExpression change
+      MorpheWeightIndex mWeightIndex;
+      bool              mWeightIndexDirty;
+      unsigned int      mIndexedItemCount;
+
+      // Weights and active items of the last evaluation, shared by every
+      // deformed geometry. The stamp changes with the active set.
+      std::vector<float> mWeights;
+      MorpheActiveArray mActive;
+      unsigned int      mActiveStamp;
+      bool              mActiveDirty;
+
+      // Output mesh of the geometry deform is building targets for, when
+      // its raw points are read, null otherwise
+      MObject           mOutputMesh;
+
+      // Deltas kept between evaluations, per deformed geometry index.
+      // Cleared whenever a cached item may be destroyed.
+      std::map<unsigned int, MorpheGeometryDeltas> mDeltas;
+
+      // Mapped target library, reopened when libraryPath changes
+      MorpheLibrary     mLibrary;
+      bool              mLibraryDirty;
+
+      // Library items loaded on demand when streaming, destroyed before the
+      // library. The window is gathered again when the time or the active
+      // set changes; kept deltas are dropped once the stream evicted items.
+      // The anim curves driving the weights, per weight logical index, are
+      // sampled again as they are connected and edited.
+      MorpheItemStream  mStream;
+      std::map<unsigned int, MorpheWeightCurve> mWeightCurves;
+      MCallbackId       mCurveEditedId;
+      MTime             mStreamTime;
+      unsigned int      mStreamStamp;
+      unsigned int      mStreamEvictions;
+
+      MorpheMayaParallel mParallel;
+
+      // Target cache counters
+      unsigned int      mCacheHits;
+      unsigned int      mCacheMisses;
+
+      // Output points already computed, keyed on the active items, the
+      // envelope and the input version. The version changes with every
+      // input but the weights and the envelope.
+      MorpheResultCache mResultCache;
+      unsigned int      mInputVersion;
+
+      MorpheStats       mStats;
 };
 // -----------------------------------------------------------------------------
 
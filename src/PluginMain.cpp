@@ -26,6 +26,12 @@ MStatus initializePlugin( MObject obj )
    MStatus   status;
    MFnPlugin plugin( obj, "Frank Barton", "0.01", "Any");
 
+   // Used by MorpheNode for parallel accumulation
+   MThreadPool::init();
+
+   // Deform phases in the Evaluation Profiler
+   MorpheNode::profilerCategory = MProfiler::addCategory("morphe", "Morphe deformer phases");
+
    status = plugin.registerNode("morphe", MorpheNode::id, MorpheNode::creator, MorpheNode::initialize, MPxNode::kDeformerNode);
    status = plugin.registerCommand( "morphe", MorpheCmd::creator, MorpheCmd::newSyntax );
 
@@ -50,6 +56,11 @@ MStatus uninitializePlugin( MObject obj)
    status = plugin.deregisterNode( MorpheNode::id );
    status = plugin.deregisterCommand( "morphe" );
 
+   MThreadPool::release();
+
+   MProfiler::removeCategory(MorpheNode::profilerCategory);
+   MorpheNode::profilerCategory = -1;
+
    return status;
 }
 // -----------------------------------------------------------------------------
\ No newline at end of file
@@ -0,0 +1,316 @@
+// -----------------------------------------------------------------------------
+// MorpheAccumulator.cpp - C++ File
+// -----------------------------------------------------------------------------
+
+
+//
+// Includes
+//
+#include "MorpheAccumulator.h"
+#include "MorpheKernels.h"
+
+#include <algorithm>
+#include <map>
+// -----------------------------------------------------------------------------
+
+
+//
+// Accumulation task over one chunk of vertices
+//
+struct MorpheAccumulateTask
+{
+   const MorpheTermArray   *terms;
+   MorpheDeltas            *deltas;
+};
+
+static void AccumulateChunk(void *pData, unsigned int uTask)
+{
+   MorpheAccumulateTask *pTask = (MorpheAccumulateTask*)pData;
+   unsigned int uBegin = uTask * MORPHE_CHUNK_SIZE;
+   MorpheAccumulateRange(*pTask->terms, *pTask->deltas, uBegin, uBegin + MORPHE_CHUNK_SIZE);
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method adds every weighted target to the deltas, in term order.
+//      With a parallel runner the vertices are split in fixed chunks; every
+//      vertex still sums its targets in term order, so the result is the
+//      same bit for bit whatever the number of threads.
+//
+void MorpheAccumulate(const MorpheTermArray &terms, MorpheDeltas &deltas, MorpheParallel *pParallel)
+{
+   unsigned int uChunkCount = (deltas.Count() + MORPHE_CHUNK_SIZE - 1) / MORPHE_CHUNK_SIZE;
+   if(pParallel == NULL || uChunkCount < 2 || terms.empty())
+   {
+      MorpheAccumulateRange(terms, deltas, 0, deltas.Count());
+      return;
+   }
+
+   MorpheAccumulateTask task;
+   task.terms  = &terms;
+   task.deltas = &deltas;
+   pParallel->Run(uChunkCount, AccumulateChunk, &task);
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method finds the part of a target covering the vertices in
+//      [uBegin, uEnd): delta positions [kFirst, kLast).
+//
+// Return Values:
+//    false if the target moves none of these vertices
+//
+static bool GetSpan(const MorpheTarget &target, unsigned int uBegin, unsigned int uEnd, unsigned int uVertexCount, size_t &kFirst, size_t &kLast)
+{
+   if(target.Count() == 0)
+      return false;
+
+   if(target.IsDense())
+   {
+      kFirst = uBegin;
+      kLast  = uEnd < target.Count() ? uEnd : target.Count();
+      return kFirst < kLast;
+   }
+
+   const unsigned int *pFirst = &target.indices[0];
+   const unsigned int *pLast  = pFirst + target.indices.size();
+   if(uBegin > 0)
+      pFirst = std::lower_bound(pFirst, pLast, uBegin);
+   if(uEnd < uVertexCount)
+      pLast = std::lower_bound(pFirst, pLast, uEnd);
+
+   kFirst = pFirst - &target.indices[0];
+   kLast  = pLast - &target.indices[0];
+   return kFirst < kLast;
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method adds the deltas [kFirst, kLast) of a target times wt.
+//
+void MorpheAccumulateSpan(const MorpheKernels &kernels, const MorpheTarget &target, float wt, size_t kFirst, size_t kLast, float *pX, float *pY, float *pZ)
+{
+   unsigned int uCount = (unsigned int)(kLast - kFirst);
+
+   // Quantized deltas are expanded by the kernels, weight included
+   float offset[3], scale[3];
+   bool  bQuantized = target.IsQuantized();
+   if(bQuantized)
+   {
+      for(int i = 0; i < 3; i++)
+      {
+         offset[i] = target.qOffset[i] * wt;
+         scale[i]  = target.qStep[i] * wt;
+      }
+   }
+
+   if(target.IsDense())
+   {
+      if(bQuantized)
+      {
+         kernels.AccumulateDenseQ(pX + kFirst, &target.qx[kFirst], offset[0], scale[0], uCount);
+         kernels.AccumulateDenseQ(pY + kFirst, &target.qy[kFirst], offset[1], scale[1], uCount);
+         kernels.AccumulateDenseQ(pZ + kFirst, &target.qz[kFirst], offset[2], scale[2], uCount);
+      }
+      else
+      {
+         kernels.AccumulateDense(pX + kFirst, &target.dx[kFirst], wt, uCount);
+         kernels.AccumulateDense(pY + kFirst, &target.dy[kFirst], wt, uCount);
+         kernels.AccumulateDense(pZ + kFirst, &target.dz[kFirst], wt, uCount);
+      }
+   }
+   else if(bQuantized)
+   {
+      kernels.AccumulateSparseQ(pX, pY, pZ, &target.indices[kFirst], &target.qx[kFirst], &target.qy[kFirst], &target.qz[kFirst], offset, scale, uCount);
+   }
+   else
+   {
+      kernels.AccumulateSparse(pX, pY, pZ, &target.indices[kFirst], &target.dx[kFirst], &target.dy[kFirst], &target.dz[kFirst], wt, uCount);
+   }
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method adds every weighted target to the deltas of the vertices
+//      in [uBegin, uEnd). Terms are applied in order so a vertex always sums
+//      its targets the same way whatever the range it belongs to.
+//
+void MorpheAccumulateRange(const MorpheTermArray &terms, MorpheDeltas &deltas, unsigned int uBegin, unsigned int uEnd)
+{
+   const MorpheKernels &kernels = MorpheGetKernels();
+
+   if(uEnd > deltas.Count())
+      uEnd = deltas.Count();
+   if(uBegin >= uEnd)
+      return;
+
+   float *pX = &deltas.x[0];
+   float *pY = &deltas.y[0];
+   float *pZ = &deltas.z[0];
+
+   for(size_t t = 0; t < terms.size(); t++)
+   {
+      const MorpheTarget &target = *terms[t].target;
+      float  wt = terms[t].weight;
+      size_t kFirst, kLast;
+      if(wt == 0.0f || !GetSpan(target, uBegin, uEnd, deltas.Count(), kFirst, kLast))
+         continue;
+
+      MorpheAccumulateSpan(kernels, target, wt, kFirst, kLast, pX, pY, pZ);
+   }
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Frame batch: rows of a target and its weight in each frame, target major so
+//    one target span is reused by every frame. Every frame uses its rows in
+//    the order of its terms, one row per term.
+//
+struct MorpheFramesTask
+{
+   std::vector<const MorpheTarget*> targets;
+   std::vector<float>               weights;       // targets x frames
+   std::vector<MorpheDeltas>        *frameDeltas;
+   unsigned int                     uVertexCount;
+};
+
+static void AccumulateFramesRange(const MorpheFramesTask &task, unsigned int uBegin, unsigned int uEnd)
+{
+   const MorpheKernels &kernels = MorpheGetKernels();
+   size_t uFrameCount = task.frameDeltas->size();
+
+   for(size_t t = 0; t < task.targets.size(); t++)
+   {
+      const MorpheTarget &target = *task.targets[t];
+      const float *pWeights = &task.weights[t * uFrameCount];
+      size_t kFirst, kLast;
+      if(!GetSpan(target, uBegin, uEnd, task.uVertexCount, kFirst, kLast))
+         continue;
+
+      for(size_t f = 0; f < uFrameCount; f++)
+      {
+         if(pWeights[f] == 0.0f)
+            continue;
+         MorpheDeltas &deltas = (*task.frameDeltas)[f];
+         MorpheAccumulateSpan(kernels, target, pWeights[f], kFirst, kLast, &deltas.x[0], &deltas.y[0], &deltas.z[0]);
+      }
+   }
+}
+
+static void AccumulateFramesChunk(void *pData, unsigned int uTask)
+{
+   MorpheFramesTask *pTask = (MorpheFramesTask*)pData;
+   unsigned int uBegin = uTask * MORPHE_CHUNK_SIZE;
+   unsigned int uEnd   = uBegin + MORPHE_CHUNK_SIZE < pTask->uVertexCount ? uBegin + MORPHE_CHUNK_SIZE : pTask->uVertexCount;
+   AccumulateFramesRange(*pTask, uBegin, uEnd);
+}
+
+//
+// Merges the terms of frame f into the rows. A term takes the next row of its
+//    target after the row of the previous term, or else a new row inserted
+//    right there, so the rows stay in the term order of every frame so far.
+//
+static void AddFrameRows(MorpheFramesTask &task, const MorpheTermArray &terms, size_t f, size_t uFrameCount)
+{
+   typedef std::map<const MorpheTarget*, std::vector<size_t> > RowMap;
+
+   RowMap rows;
+   for(size_t r = 0; r < task.targets.size(); r++)
+      rows[task.targets[r]].push_back(r);
+
+   // Rows taken, and terms inserted before an existing row
+   std::vector< std::pair<size_t, size_t> > inserts;    // row, term
+   size_t uCursor = 0;
+   for(size_t n = 0; n < terms.size(); n++)
+   {
+      const MorpheTerm &term = terms[n];
+      if(term.weight == 0.0f || term.target->Count() == 0)
+         continue;
+
+      RowMap::const_iterator it = rows.find(term.target);
+      if(it != rows.end())
+      {
+         std::vector<size_t>::const_iterator itRow = std::lower_bound(it->second.begin(), it->second.end(), uCursor);
+         if(itRow != it->second.end())
+         {
+            task.weights[*itRow * uFrameCount + f] = term.weight;
+            uCursor = *itRow + 1;
+            continue;
+         }
+      }
+      inserts.push_back(std::make_pair(uCursor, n));
+   }
+   if(inserts.empty())
+      return;
+
+   std::vector<const MorpheTarget*> targets;
+   std::vector<float>               weights;
+   size_t uRowCount = task.targets.size() + inserts.size();
+   targets.reserve(uRowCount);
+   weights.reserve(uRowCount * uFrameCount);
+
+   size_t i = 0;
+   for(size_t r = 0; r <= task.targets.size(); r++)
+   {
+      for(; i < inserts.size() && inserts[i].first == r; i++)
+      {
+         const MorpheTerm &term = terms[inserts[i].second];
+         targets.push_back(term.target);
+         weights.resize(weights.size() + uFrameCount, 0.0f);
+         weights[weights.size() - uFrameCount + f] = term.weight;
+      }
+      if(r < task.targets.size())
+      {
+         targets.push_back(task.targets[r]);
+         weights.insert(weights.end(), task.weights.begin() + r * uFrameCount, task.weights.begin() + (r + 1) * uFrameCount);
+      }
+   }
+
+   task.targets.swap(targets);
+   task.weights.swap(weights);
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method evaluates several frames at once, frameTerms[f] giving the
+//      terms of frame f. It is the product of the frames x targets weight
+//      matrix with the targets, done by blocks of vertices: each block of a
+//      target is loaded once for every frame. A frame adds its terms one at
+//      a time in their order, a target used twice being added twice, so it
+//      gets the same deltas as MorpheAccumulate, bit for bit, whatever the
+//      other frames of the batch and the number of threads. Every
+//      frameDeltas must already have the vertex count.
+//
+void MorpheAccumulateFrames(const std::vector<MorpheTermArray> &frameTerms, std::vector<MorpheDeltas> &frameDeltas, MorpheParallel *pParallel)
+{
+   if(frameDeltas.empty() || frameDeltas.size() != frameTerms.size())
+      return;
+
+   MorpheFramesTask task;
+   task.frameDeltas  = &frameDeltas;
+   task.uVertexCount = frameDeltas[0].Count();
+
+   size_t uFrameCount = frameTerms.size();
+   for(size_t f = 0; f < uFrameCount; f++)
+      AddFrameRows(task, frameTerms[f], f, uFrameCount);
+   if(task.targets.empty())
+      return;
+
+   unsigned int uChunkCount = (task.uVertexCount + MORPHE_CHUNK_SIZE - 1) / MORPHE_CHUNK_SIZE;
+   if(pParallel == NULL || uChunkCount < 2)
+      AccumulateFramesRange(task, 0, task.uVertexCount);
+   else
+      pParallel->Run(uChunkCount, AccumulateFramesChunk, &task);
+}
+// -----------------------------------------------------------------------------
@@ -0,0 +1,43 @@
+// -----------------------------------------------------------------------------
+// MorpheAccumulator.h - C++ File
+// -----------------------------------------------------------------------------
+
+#ifndef MORPHE_ACCUMULATOR_H
+#define MORPHE_ACCUMULATOR_H
+
+
+//
+// Includes
+//
+#include "MorpheParallel.h"
+#include "MorpheTarget.h"
+
+#include <vector>
+// -----------------------------------------------------------------------------
+
+
+//
+// MorpheTerm - A target and the weight it is accumulated with
+//
+struct MorpheTerm
+{
+   const MorpheTarget   *target;
+   float                weight;
+};
+
+typedef std::vector<MorpheTerm> MorpheTermArray;
+
+struct MorpheKernels;
+// -----------------------------------------------------------------------------
+
+
+//
+// Functions
+//
+void  MorpheAccumulate(const MorpheTermArray &terms, MorpheDeltas &deltas, MorpheParallel *pParallel = NULL);
+void  MorpheAccumulateRange(const MorpheTermArray &terms, MorpheDeltas &deltas, unsigned int uBegin, unsigned int uEnd);
+void  MorpheAccumulateSpan(const MorpheKernels &kernels, const MorpheTarget &target, float wt, size_t kFirst, size_t kLast, float *pX, float *pY, float *pZ);
+void  MorpheAccumulateFrames(const std::vector<MorpheTermArray> &frameTerms, std::vector<MorpheDeltas> &frameDeltas, MorpheParallel *pParallel = NULL);
+// -----------------------------------------------------------------------------
+
+#endif
@@ -0,0 +1,328 @@
+// -----------------------------------------------------------------------------
+// MorpheBasis.cpp - C++ File
+// -----------------------------------------------------------------------------
+
+
+//
+// Includes
+//
+#include "MorpheBasis.h"
+
+#include <algorithm>
+#include <math.h>
+// -----------------------------------------------------------------------------
+
+
+//
+// Eigenvalue order, largest first
+//
+struct MorpheEigenGreater
+{
+   const std::vector<double>  *values;
+
+   bool operator()(unsigned int a, unsigned int b) const
+   {
+      return (*values)[a] > (*values)[b];
+   }
+};
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    Constructor.
+//
+MorpheBasis::MorpheBasis()
+   : mBuilt(false)
+{
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method releases the basis.
+//
+void MorpheBasis::Clear()
+{
+   mColumns.clear();
+   mProjection.clear();
+   mShapes.clear();
+   mEigenvalues.clear();
+   mBuilt = false;
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method diagonalizes the symmetric n x n matrix a, row major, with
+//      cyclic Jacobi rotations. The eigenvalues are left on the diagonal of
+//      a and the matching eigenvectors in the columns of v.
+//
+void MorpheBasis::Diagonalize(std::vector<double> &a, unsigned int n, std::vector<double> &v)
+{
+   v.assign((size_t)n * n, 0.0);
+   for(unsigned int i = 0; i < n; i++)
+      v[(size_t)i * n + i] = 1.0;
+
+   double dDiagonal = 0.0;
+   for(unsigned int i = 0; i < n; i++)
+      dDiagonal += a[(size_t)i * n + i] * a[(size_t)i * n + i];
+
+   for(unsigned int uSweep = 0; uSweep < MORPHE_BASIS_SWEEPS; uSweep++)
+   {
+      double dOff = 0.0;
+      for(unsigned int p = 0; p < n; p++)
+         for(unsigned int q = p + 1; q < n; q++)
+            dOff += a[(size_t)p * n + q] * a[(size_t)p * n + q];
+      if(dOff <= dDiagonal * 1.0e-24)
+         break;
+
+      for(unsigned int p = 0; p < n; p++)
+      {
+         for(unsigned int q = p + 1; q < n; q++)
+         {
+            double apq = a[(size_t)p * n + q];
+            if(apq == 0.0)
+               continue;
+
+            double theta = (a[(size_t)q * n + q] - a[(size_t)p * n + p]) / (2.0 * apq);
+            double t = (theta >= 0.0 ? 1.0 : -1.0) / (fabs(theta) + sqrt(theta * theta + 1.0));
+            double c = 1.0 / sqrt(t * t + 1.0);
+            double s = t * c;
+
+            // a = J' a J, the rotation J only mixes columns and rows p and q
+            for(unsigned int k = 0; k < n; k++)
+            {
+               double akp = a[(size_t)k * n + p];
+               double akq = a[(size_t)k * n + q];
+               a[(size_t)k * n + p] = c * akp - s * akq;
+               a[(size_t)k * n + q] = s * akp + c * akq;
+            }
+            for(unsigned int k = 0; k < n; k++)
+            {
+               double apk = a[(size_t)p * n + k];
+               double aqk = a[(size_t)q * n + k];
+               a[(size_t)p * n + k] = c * apk - s * aqk;
+               a[(size_t)q * n + k] = s * apk + c * aqk;
+            }
+            a[(size_t)p * n + q] = 0.0;
+            a[(size_t)q * n + p] = 0.0;
+
+            for(unsigned int k = 0; k < n; k++)
+            {
+               double vkp = v[(size_t)k * n + p];
+               double vkq = v[(size_t)k * n + q];
+               v[(size_t)k * n + p] = c * vkp - s * vkq;
+               v[(size_t)k * n + q] = s * vkp + c * vkq;
+            }
+         }
+      }
+   }
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method factorizes the targets built against uVertexCount vertices.
+//      The fewest shapes whose error is within tolerance are kept, at most
+//      uMaxShapes of them unless it is 0. Targets built against another
+//      vertex count are left out and accumulated as they are.
+//
+void MorpheBasis::Build(const std::vector<const MorpheTarget*> &targets, unsigned int uVertexCount, float tolerance, unsigned int uMaxShapes, MorpheParallel *pParallel)
+{
+   Clear();
+   mBuilt = true;
+
+   // Float deltas of every target, quantized ones are expanded
+   std::vector<const MorpheTarget*> columns;
+   unsigned int uQuantizedCount = 0;
+   for(size_t i = 0; i < targets.size(); i++)
+   {
+      if(targets[i]->vertexCount != uVertexCount || targets[i]->Count() == 0 || mColumns.count(targets[i]))
+         continue;
+      mColumns[targets[i]] = (unsigned int)columns.size();
+      columns.push_back(targets[i]);
+      if(targets[i]->IsQuantized())
+         uQuantizedCount++;
+   }
+
+   unsigned int n = (unsigned int)columns.size();
+   if(n == 0)
+      return;
+
+   std::vector<MorpheTarget> expanded;
+   std::vector<const MorpheTarget*> floats(columns);
+   expanded.reserve(uQuantizedCount);
+   for(unsigned int i = 0; i < n; i++)
+   {
+      if(!columns[i]->IsQuantized())
+         continue;
+      expanded.push_back(*columns[i]);
+      expanded.back().Dequantize();
+      floats[i] = &expanded.back();
+   }
+
+   // Gram matrix D'D, one target is expanded at a time
+   std::vector<double> gram((size_t)n * n, 0.0);
+   std::vector<float>  x(uVertexCount, 0.0f), y(uVertexCount, 0.0f), z(uVertexCount, 0.0f);
+   for(unsigned int i = 0; i < n; i++)
+   {
+      const MorpheTarget &ti = *floats[i];
+      for(unsigned int k = 0; k < ti.Count(); k++)
+      {
+         unsigned int j = ti.Index(k);
+         x[j] = ti.dx[k];
+         y[j] = ti.dy[k];
+         z[j] = ti.dz[k];
+      }
+
+      for(unsigned int c = i; c < n; c++)
+      {
+         const MorpheTarget &tc = *floats[c];
+         double dDot = 0.0;
+         for(unsigned int k = 0; k < tc.Count(); k++)
+         {
+            unsigned int j = tc.Index(k);
+            dDot += (double)tc.dx[k] * x[j] + (double)tc.dy[k] * y[j] + (double)tc.dz[k] * z[j];
+         }
+         gram[(size_t)i * n + c] = dDot;
+         gram[(size_t)c * n + i] = dDot;
+      }
+
+      for(unsigned int k = 0; k < ti.Count(); k++)
+      {
+         unsigned int j = ti.Index(k);
+         x[j] = y[j] = z[j] = 0.0f;
+      }
+   }
+
+   // Principal directions, largest eigenvalues first
+   std::vector<double> eigenvectors;
+   Diagonalize(gram, n, eigenvectors);
+
+   std::vector<double> values(n);
+   std::vector<unsigned int> order(n);
+   for(unsigned int i = 0; i < n; i++)
+   {
+      values[i] = std::max(gram[(size_t)i * n + i], 0.0);
+      order[i]  = i;
+   }
+   MorpheEigenGreater greater;
+   greater.values = &values;
+   std::sort(order.begin(), order.end(), greater);
+
+   mEigenvalues.resize(n);
+   for(unsigned int i = 0; i < n; i++)
+      mEigenvalues[i] = values[order[i]];
+
+   // Fewest shapes within tolerance, numerically null directions are never kept
+   unsigned int uShapeCount = 0;
+   while(uShapeCount < n && Error(uShapeCount) > tolerance && mEigenvalues[uShapeCount] > mEigenvalues[0] * 1.0e-12)
+      uShapeCount++;
+   if(uMaxShapes > 0 && uShapeCount > uMaxShapes)
+      uShapeCount = uMaxShapes;
+
+   // Shapes B = D V and the projection of target weights on them
+   mProjection.resize((size_t)n * uShapeCount);
+   mShapes.resize(uShapeCount);
+
+   MorpheTermArray terms(n);
+   MorpheDeltas    shape;
+   for(unsigned int s = 0; s < uShapeCount; s++)
+   {
+      for(unsigned int i = 0; i < n; i++)
+      {
+         float fV = (float)eigenvectors[(size_t)i * n + order[s]];
+         mProjection[(size_t)i * uShapeCount + s] = fV;
+         terms[i].target = columns[i];
+         terms[i].weight = fV;
+      }
+
+      shape.Resize(uVertexCount);
+      MorpheAccumulate(terms, shape, pParallel);
+
+      MorpheTarget &target = mShapes[s];
+      target.vertexCount = uVertexCount;
+      target.dx.swap(shape.x);
+      target.dy.swap(shape.y);
+      target.dz.swap(shape.z);
+   }
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method returns the error of the first uShapeCount shapes.
+//
+float MorpheBasis::Error(unsigned int uShapeCount) const
+{
+   double dTotal = 0.0, dDropped = 0.0;
+   for(size_t i = mEigenvalues.size(); i > 0; i--)
+   {
+      dTotal += mEigenvalues[i - 1];
+      if(i > uShapeCount)
+         dDropped += mEigenvalues[i - 1];
+   }
+   return dTotal > 0.0 ? (float)sqrt(dDropped / dTotal) : 0.0f;
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method adds weighted targets to the deltas through the basis.
+//      Target weights are projected on the shapes, then the shapes with a
+//      non zero coefficient are accumulated. Targets outside the basis are
+//      accumulated directly.
+//
+void MorpheBasis::Accumulate(const MorpheTermArray &terms, MorpheDeltas &deltas, MorpheParallel *pParallel) const
+{
+   unsigned int         uShapeCount = ShapeCount();
+   std::vector<float>   coefficients(uShapeCount, 0.0f);
+   MorpheTermArray      shapeTerms;
+
+   for(size_t t = 0; t < terms.size(); t++)
+   {
+      std::map<const MorpheTarget*, unsigned int>::const_iterator it = mColumns.find(terms[t].target);
+      if(it == mColumns.end())
+      {
+         shapeTerms.push_back(terms[t]);
+         continue;
+      }
+
+      const float *pRow = uShapeCount > 0 ? &mProjection[(size_t)it->second * uShapeCount] : NULL;
+      for(unsigned int s = 0; s < uShapeCount; s++)
+         coefficients[s] += terms[t].weight * pRow[s];
+   }
+
+   for(unsigned int s = 0; s < uShapeCount; s++)
+   {
+      if(coefficients[s] == 0.0f)
+         continue;
+      MorpheTerm term;
+      term.target = &mShapes[s];
+      term.weight = coefficients[s];
+      shapeTerms.push_back(term);
+   }
+
+   MorpheAccumulate(shapeTerms, deltas, pParallel);
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method returns the memory used by the shapes and the projection.
+//
+size_t MorpheBasis::MemorySize() const
+{
+   size_t uSize = mProjection.size() * sizeof(float);
+   for(size_t s = 0; s < mShapes.size(); s++)
+      uSize += mShapes[s].MemorySize();
+   return uSize;
+}
+// -----------------------------------------------------------------------------
@@ -0,0 +1,60 @@
+// -----------------------------------------------------------------------------
+// MorpheBasis.h - C++ File
+// -----------------------------------------------------------------------------
+
+#ifndef MORPHE_BASIS_H
+#define MORPHE_BASIS_H
+
+
+//
+// Includes
+//
+#include "MorpheAccumulator.h"
+
+#include <map>
+#include <vector>
+// -----------------------------------------------------------------------------
+
+
+// Jacobi sweeps at most when diagonalizing the Gram matrix of the targets.
+#define MORPHE_BASIS_SWEEPS      50
+// -----------------------------------------------------------------------------
+
+
+//
+// MorpheBasis - Low rank approximation of a set of targets. The delta matrix
+//    D, one column per target, is reduced to its K leading principal shapes
+//    B = D V, V being the eigenvectors of D'D. A weighted sum of targets D w
+//    is then evaluated as the K basis shapes weighted by V' w.
+//
+//    The error of K shapes is the relative Frobenius norm of what is left
+//    out: sqrt(sum of the dropped eigenvalues / sum of all eigenvalues).
+//
+class MorpheBasis
+{
+public:
+                  MorpheBasis();
+
+   void           Clear();
+   void           Build(const std::vector<const MorpheTarget*> &targets, unsigned int uVertexCount, float tolerance, unsigned int uMaxShapes, MorpheParallel *pParallel = NULL);
+   void           Accumulate(const MorpheTermArray &terms, MorpheDeltas &deltas, MorpheParallel *pParallel = NULL) const;
+
+   bool           IsBuilt() const                  { return mBuilt; }
+   unsigned int   ShapeCount() const               { return (unsigned int)mShapes.size(); }
+   unsigned int   TargetCount() const              { return (unsigned int)mColumns.size(); }
+   float          Error() const                    { return Error(ShapeCount()); }
+   float          Error(unsigned int uShapeCount) const;
+   size_t         MemorySize() const;
+
+private:
+   static void    Diagonalize(std::vector<double> &a, unsigned int n, std::vector<double> &v);
+
+   std::map<const MorpheTarget*, unsigned int>  mColumns;      // Target -> row of mProjection
+   std::vector<float>                           mProjection;   // Target count x shape count
+   std::vector<MorpheTarget>                    mShapes;       // Dense basis shapes
+   std::vector<double>                          mEigenvalues;  // Every eigenvalue, descending
+   bool                                         mBuilt;
+};
+// -----------------------------------------------------------------------------
+
+#endif
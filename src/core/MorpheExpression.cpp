@@ -0,0 +1,419 @@
+// -----------------------------------------------------------------------------
+// MorpheExpression.cpp - C++ File
+// -----------------------------------------------------------------------------
+
+
+//
+// Includes
+//
+#include "MorpheExpression.h"
+
+#include <algorithm>
+#include <ctype.h>
+#include <locale>
+#include <sstream>
+#include <stdio.h>
+#include <stdlib.h>
+// -----------------------------------------------------------------------------
+
+
+//
+// Recursive descent parser emitting the bytecode as it goes
+//
+struct MorpheExpression::Parser
+{
+   MorpheExpression  *expression;
+   const char        *text;
+   const char        *p;
+   int               nesting;
+   std::string       error;
+
+   void SkipSpaces()
+   {
+      while(isspace((unsigned char)*p))
+         p++;
+   }
+
+   bool Accept(char c)
+   {
+      SkipSpaces();
+      if(*p != c)
+         return false;
+      p++;
+      return true;
+   }
+
+   bool Fail(const char *pMessage)
+   {
+      if(error.empty())
+      {
+         char buffer[32];
+         sprintf(buffer, " at column %d", (int)(p - text) + 1);
+         error = std::string(pMessage) + buffer;
+      }
+      return false;
+   }
+
+   bool Expect(char c)
+   {
+      if(Accept(c))
+         return true;
+      char message[16];
+      sprintf(message, "'%c' expected", c);
+      return Fail(message);
+   }
+
+   bool Expr()
+   {
+      if(!Term())
+         return false;
+      for(;;)
+      {
+         if(Accept('+'))
+         {
+            if(!Term())
+               return false;
+            expression->Emit(kAdd, -1);
+         }
+         else if(Accept('-'))
+         {
+            if(!Term())
+               return false;
+            expression->Emit(kSubtract, -1);
+         }
+         else
+            return true;
+      }
+   }
+
+   bool Term()
+   {
+      if(!Unary())
+         return false;
+      for(;;)
+      {
+         if(Accept('*'))
+         {
+            if(!Unary())
+               return false;
+            expression->Emit(kMultiply, -1);
+         }
+         else if(Accept('/'))
+         {
+            if(!Unary())
+               return false;
+            expression->Emit(kDivide, -1);
+         }
+         else
+            return true;
+      }
+   }
+
+   bool Unary()
+   {
+      // Every recursion goes through here
+      if(nesting >= MORPHE_EXPRESSION_NESTING)
+         return Fail("expression nested too deep");
+      nesting++;
+
+      bool bOk;
+      if(Accept('-'))
+      {
+         bOk = Unary();
+         if(bOk)
+            expression->Emit(kNegate, 0);
+      }
+      else
+      {
+         Accept('+');
+         bOk = Primary();
+      }
+
+      nesting--;
+      return bOk;
+   }
+
+   bool Number(float &value)
+   {
+      // Scanned here and read in the classic locale, whatever the
+      // decimal separator of the current one
+      const char *pBegin = p;
+      bool bDigits = false;
+      for(; isdigit((unsigned char)*p); p++)
+         bDigits = true;
+      if(*p == '.')
+      {
+         for(p++; isdigit((unsigned char)*p); p++)
+            bDigits = true;
+      }
+      if(!bDigits)
+      {
+         p = pBegin;
+         return Fail("number expected");
+      }
+      if(*p == 'e' || *p == 'E')
+      {
+         const char *pExponent = p++;
+         if(*p == '+' || *p == '-')
+            p++;
+         if(!isdigit((unsigned char)*p))
+            p = pExponent;
+         while(isdigit((unsigned char)*p))
+            p++;
+      }
+
+      std::istringstream stream(std::string(pBegin, p));
+      stream.imbue(std::locale::classic());
+      double dValue = 0.0;
+      stream >> dValue;
+      value = (float)dValue;
+      return true;
+   }
+
+   bool Arguments(unsigned int uCount)
+   {
+      if(!Expect('('))
+         return false;
+      for(unsigned int i = 0; i < uCount; i++)
+      {
+         if(i > 0 && !Expect(','))
+            return false;
+         if(!Expr())
+            return false;
+      }
+      return Expect(')');
+   }
+
+   bool Primary()
+   {
+      SkipSpaces();
+
+      // Number
+      if(isdigit((unsigned char)*p) || *p == '.')
+      {
+         float value;
+         if(!Number(value))
+            return false;
+         expression->Emit(kConstant, (unsigned int)expression->mConstants.size(), 1);
+         expression->mConstants.push_back(value);
+         return true;
+      }
+
+      // Parenthesized expression
+      if(*p == '(')
+      {
+         p++;
+         return Expr() && Expect(')');
+      }
+
+      // Weight or function
+      const char *pName = p;
+      while(isalnum((unsigned char)*p) || *p == '_')
+         p++;
+      std::string name(pName, p);
+      if(name.empty())
+         return Fail(*p ? "unexpected character" : "unexpected end");
+
+      if(name == "w" || name == "weight")
+      {
+         if(!Expect('['))
+            return false;
+         SkipSpaces();
+         if(!isdigit((unsigned char)*p))
+            return Fail("weight index expected");
+         unsigned long uIndex = strtoul(p, (char**)&p, 10);
+         if(!Expect(']'))
+            return false;
+         expression->Emit(kWeight, (unsigned int)uIndex, 1);
+         return true;
+      }
+
+      if(name == "abs")
+      {
+         if(!Arguments(1))
+            return false;
+         expression->Emit(kAbs, 0);
+      }
+      else if(name == "min" || name == "max")
+      {
+         if(!Arguments(2))
+            return false;
+         expression->Emit(name == "min" ? kMin : kMax, -1);
+      }
+      else if(name == "clamp" || name == "linstep" || name == "smoothstep")
+      {
+         if(!Arguments(3))
+            return false;
+         expression->Emit(name == "clamp" ? kClamp : (name == "linstep" ? kLinstep : kSmoothstep), -2);
+      }
+      else
+      {
+         p = pName;
+         return Fail(("unknown name '" + name + "'").c_str());
+      }
+      return true;
+   }
+};
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    Constructor.
+//
+MorpheExpression::MorpheExpression()
+   : mDepth(0), mMaxDepth(0)
+{
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method forgets the compiled expression.
+//
+void MorpheExpression::Clear()
+{
+   mCode.clear();
+   mConstants.clear();
+   mDepth    = 0;
+   mMaxDepth = 0;
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    These methods append an op, iDepth is the change of stack depth it
+//      makes.
+//
+void MorpheExpression::Emit(Op op, int iDepth)
+{
+   mCode.push_back(op);
+   mDepth   += iDepth;
+   mMaxDepth = std::max(mMaxDepth, mDepth);
+}
+
+void MorpheExpression::Emit(Op op, unsigned int uOperand, int iDepth)
+{
+   Emit(op, iDepth);
+   mCode.push_back(uOperand);
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method compiles an expression. On failure the expression is left
+//      empty and pError, if given, tells what went wrong and where.
+//
+// Return Values:
+//    true if the expression compiled
+//
+bool MorpheExpression::Compile(const char *pText, std::string *pError)
+{
+   Clear();
+
+   Parser parser;
+   parser.expression = this;
+   parser.text       = pText;
+   parser.p          = pText;
+   parser.nesting    = 0;
+
+   bool bOk = parser.Expr();
+   parser.SkipSpaces();
+   if(bOk && *parser.p != '\0')
+      bOk = parser.Fail("unexpected character");
+   if(bOk && mMaxDepth > MORPHE_EXPRESSION_STACK)
+      bOk = parser.Fail("expression too deep");
+
+   if(!bOk)
+   {
+      Clear();
+      if(pError)
+         *pError = parser.error;
+   }
+   return bOk;
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method evaluates the expression, weights missing from the array
+//      are zero.
+//
+// Return Values:
+//    the value of the expression, 0 if it is empty
+//
+float MorpheExpression::Evaluate(const std::vector<float> &weights) const
+{
+   float stack[MORPHE_EXPRESSION_STACK];
+   int   sp = -1;
+
+   const unsigned int *pCode = mCode.empty() ? NULL : &mCode[0];
+   const unsigned int *pEnd  = pCode + mCode.size();
+   while(pCode < pEnd)
+   {
+      switch(*pCode++)
+      {
+         case kConstant:
+            stack[++sp] = mConstants[*pCode++];
+            break;
+         case kWeight:
+         {
+            unsigned int uIndex = *pCode++;
+            stack[++sp] = uIndex < weights.size() ? weights[uIndex] : 0.0f;
+            break;
+         }
+         case kNegate:
+            stack[sp] = -stack[sp];
+            break;
+         case kAdd:
+            sp--;
+            stack[sp] += stack[sp + 1];
+            break;
+         case kSubtract:
+            sp--;
+            stack[sp] -= stack[sp + 1];
+            break;
+         case kMultiply:
+            sp--;
+            stack[sp] *= stack[sp + 1];
+            break;
+         case kDivide:
+            sp--;
+            stack[sp] = stack[sp + 1] != 0.0f ? stack[sp] / stack[sp + 1] : 0.0f;
+            break;
+         case kAbs:
+            stack[sp] = stack[sp] < 0.0f ? -stack[sp] : stack[sp];
+            break;
+         case kMin:
+            sp--;
+            stack[sp] = std::min(stack[sp], stack[sp + 1]);
+            break;
+         case kMax:
+            sp--;
+            stack[sp] = std::max(stack[sp], stack[sp + 1]);
+            break;
+         case kClamp:
+            sp -= 2;
+            stack[sp] = std::min(std::max(stack[sp], stack[sp + 1]), stack[sp + 2]);
+            break;
+         case kLinstep:
+         case kSmoothstep:
+         {
+            sp -= 2;
+            float lo = stack[sp], hi = stack[sp + 1], x = stack[sp + 2];
+            float t  = hi != lo ? (x - lo) / (hi - lo) : (x < lo ? 0.0f : 1.0f);
+            t = std::min(std::max(t, 0.0f), 1.0f);
+            stack[sp] = pCode[-1] == kSmoothstep ? t * t * (3.0f - 2.0f * t) : t;
+            break;
+         }
+      }
+   }
+
+   return sp >= 0 ? stack[sp] : 0.0f;
+}
+// -----------------------------------------------------------------------------
+
@@ -0,0 +1,82 @@
+// -----------------------------------------------------------------------------
+// MorpheExpression.h - C++ File
+// -----------------------------------------------------------------------------
+
+#ifndef MORPHE_EXPRESSION_H
+#define MORPHE_EXPRESSION_H
+
+
+//
+// Includes
+//
+#include <string>
+#include <vector>
+// -----------------------------------------------------------------------------
+
+
+// Evaluation stack depth, deeper expressions are rejected when compiled.
+#define MORPHE_EXPRESSION_STACK  32
+
+// Parenthesis, argument and sign nesting, deeper expressions are rejected
+// before they can exhaust the stack of the compiling thread.
+#define MORPHE_EXPRESSION_NESTING   256
+// -----------------------------------------------------------------------------
+
+
+//
+// MorpheExpression - A weight expression compiled to a stack bytecode.
+//
+//    The grammar is the usual arithmetic one:
+//
+//       expr     = term { ("+" | "-") term }
+//       term     = unary { ("*" | "/") unary }
+//       unary    = "-" unary | primary
+//       primary  = number | "w[" index "]" | function "(" expr { "," expr } ")" | "(" expr ")"
+//
+//    w[i] is the weight of logical index i, weight[i] is also accepted.
+//    Functions are abs(x), min(a, b), max(a, b), clamp(x, lo, hi),
+//    linstep(lo, hi, x) and smoothstep(lo, hi, x). A division by zero
+//    gives 0.
+//
+class MorpheExpression
+{
+public:
+                  MorpheExpression();
+
+   void           Clear();
+   bool           Compile(const char *pText, std::string *pError = NULL);
+   float          Evaluate(const std::vector<float> &weights) const;
+
+   bool           IsEmpty() const                  { return mCode.empty(); }
+
+private:
+   enum Op
+   {
+      kConstant,                       // Operand: constant index
+      kWeight,                         // Operand: weight index
+      kNegate,
+      kAdd,
+      kSubtract,
+      kMultiply,
+      kDivide,
+      kAbs,
+      kMin,
+      kMax,
+      kClamp,
+      kLinstep,
+      kSmoothstep
+   };
+
+   struct Parser;
+
+   void           Emit(Op op, int iDepth);
+   void           Emit(Op op, unsigned int uOperand, int iDepth);
+
+   std::vector<unsigned int>  mCode;         // Ops, each followed by its operand if any
+   std::vector<float>         mConstants;
+   int                        mDepth;        // Stack depth while compiling
+   int                        mMaxDepth;
+};
+// -----------------------------------------------------------------------------
+
+#endif
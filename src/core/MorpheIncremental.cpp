@@ -0,0 +1,138 @@
+// -----------------------------------------------------------------------------
+// MorpheIncremental.cpp - C++ File
+// -----------------------------------------------------------------------------
+
+
+//
+// Includes
+//
+#include "MorpheIncremental.h"
+
+#include <algorithm>
+// -----------------------------------------------------------------------------
+
+
+static bool TermTargetLess(const MorpheTerm &a, const MorpheTerm &b)
+{
+   return a.target < b.target;
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    Constructor.
+//
+MorpheIncremental::MorpheIncremental()
+   : mUpdates(0)
+   , mValid(false)
+{
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method forgets the kept terms, the next update is a full rebuild.
+//      Must be called before any kept target is destroyed.
+//
+void MorpheIncremental::Reset()
+{
+   mTerms.clear();
+   mUpdates = 0;
+   mValid   = false;
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method sorts terms by target and sums the weights of a target
+//      found more than once.
+//
+void MorpheIncremental::Sort(const MorpheTermArray &terms, MorpheTermArray &sorted)
+{
+   sorted = terms;
+   std::sort(sorted.begin(), sorted.end(), TermTargetLess);
+
+   size_t uLast = 0;
+   for(size_t i = 1; i < sorted.size(); i++)
+   {
+      if(sorted[i].target == sorted[uLast].target)
+         sorted[uLast].weight += sorted[i].weight;
+      else
+         sorted[++uLast] = sorted[i];
+   }
+   if(!sorted.empty())
+      sorted.resize(uLast + 1);
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method brings the deltas to the sum of the given terms. Targets
+//      whose weight changed since the last update are accumulated with the
+//      weight difference, removed ones with their negated weight. The
+//      deltas are rebuilt from zero instead on the first update, after a
+//      vertex count change, every MORPHE_INCREMENTAL_REBUILD updates, or
+//      when more targets changed than there are terms.
+//
+// Return Values:
+//    the number of terms accumulated
+//
+unsigned int MorpheIncremental::Update(const MorpheTermArray &terms, unsigned int uVertexCount, MorpheParallel *pParallel)
+{
+   MorpheTermArray sorted;
+   Sort(terms, sorted);
+
+   bool bRebuild = !mValid || mDeltas.Count() != uVertexCount || mUpdates >= MORPHE_INCREMENTAL_REBUILD;
+
+   // Weight differences, both arrays are ordered by target
+   MorpheTermArray changed;
+   if(!bRebuild)
+   {
+      size_t i = 0, k = 0;
+      while(i < sorted.size() || k < mTerms.size())
+      {
+         MorpheTerm term;
+         if(k == mTerms.size() || (i < sorted.size() && sorted[i].target < mTerms[k].target))
+         {
+            term = sorted[i++];
+         }
+         else if(i == sorted.size() || mTerms[k].target < sorted[i].target)
+         {
+            term.target = mTerms[k].target;
+            term.weight = -mTerms[k++].weight;
+         }
+         else
+         {
+            term.target = sorted[i].target;
+            term.weight = sorted[i++].weight - mTerms[k++].weight;
+         }
+
+         if(term.weight != 0.0f)
+            changed.push_back(term);
+      }
+      bRebuild = !changed.empty() && changed.size() >= sorted.size();
+   }
+
+   mTerms.swap(sorted);
+   mValid = true;
+
+   if(bRebuild)
+   {
+      mDeltas.Resize(uVertexCount);
+      MorpheAccumulate(terms, mDeltas, pParallel);
+      mUpdates = 0;
+      return (unsigned int)terms.size();
+   }
+
+   if(!changed.empty())
+   {
+      MorpheAccumulate(changed, mDeltas, pParallel);
+      mUpdates++;
+   }
+   return (unsigned int)changed.size();
+}
+// -----------------------------------------------------------------------------
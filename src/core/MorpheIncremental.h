@@ -0,0 +1,48 @@
+// -----------------------------------------------------------------------------
+// MorpheIncremental.h - C++ File
+// -----------------------------------------------------------------------------
+
+#ifndef MORPHE_INCREMENTAL_H
+#define MORPHE_INCREMENTAL_H
+
+
+//
+// Includes
+//
+#include "MorpheAccumulator.h"
+// -----------------------------------------------------------------------------
+
+
+// Incremental updates between two full rebuilds, bounds the float drift.
+#define MORPHE_INCREMENTAL_REBUILD  64
+// -----------------------------------------------------------------------------
+
+
+//
+// MorpheIncremental - Accumulated deltas kept between evaluations. Only the
+//    terms whose weight changed are accumulated again, with the difference
+//    of their weights. The targets of the kept terms must stay alive until
+//    Reset is called.
+//
+class MorpheIncremental
+{
+public:
+                        MorpheIncremental();
+
+   void                 Reset();
+   unsigned int         Update(const MorpheTermArray &terms, unsigned int uVertexCount, MorpheParallel *pParallel = NULL);
+
+   const MorpheDeltas   &Deltas() const            { return mDeltas; }
+   bool                 IsEmpty() const            { return mTerms.empty(); }
+
+private:
+   static void          Sort(const MorpheTermArray &terms, MorpheTermArray &sorted);
+
+   MorpheTermArray      mTerms;           // Terms of the deltas, by target
+   MorpheDeltas         mDeltas;
+   unsigned int         mUpdates;         // Incremental updates since the last rebuild
+   bool                 mValid;
+};
+// -----------------------------------------------------------------------------
+
+#endif
@@ -0,0 +1,254 @@
+// -----------------------------------------------------------------------------
+// MorpheItem.cpp - C++ File
+// -----------------------------------------------------------------------------
+
+
+//
+// Includes
+//
+#include "MorpheItem.h"
+
+#include <algorithm>
+#include <math.h>
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method sets the weights driving the item.
+//
+void MorpheItem::SetWeightIds(const int *pIds, unsigned int uCount)
+{
+   weightIds.assign(pIds, pIds + uCount);
+   std::sort(weightIds.begin(), weightIds.end());
+   weightIds.erase(std::unique(weightIds.begin(), weightIds.end()), weightIds.end());
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method adds an in-between shape reached at a weight in ]0, 1[.
+//      BuildSegments must be called once every shape is set.
+//
+MorpheTarget &MorpheItem::AddInbetween(float wt)
+{
+   inbetweenWeights.push_back(wt);
+   inbetweens.push_back(MorpheTarget());
+   return inbetweens.back();
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method sorts the in-betweens and precomputes the segment table.
+//      In-betweens outside ]0, 1[ or at an already used weight are dropped.
+//
+void MorpheItem::BuildSegments()
+{
+   std::vector< std::pair<float, size_t> > order;
+   for(size_t k = 0; k < inbetweenWeights.size(); k++)
+   {
+      if(inbetweenWeights[k] > 0.0f && inbetweenWeights[k] < 1.0f)
+         order.push_back(std::make_pair(inbetweenWeights[k], k));
+   }
+   std::sort(order.begin(), order.end());
+
+   std::vector<float>         sortedWeights;
+   std::vector<MorpheTarget>  sortedTargets;
+   for(size_t k = 0; k < order.size(); k++)
+   {
+      if(!sortedWeights.empty() && sortedWeights.back() == order[k].first)
+         continue;
+      sortedWeights.push_back(order[k].first);
+      sortedTargets.push_back(inbetweens[order[k].second]);
+   }
+   inbetweenWeights.swap(sortedWeights);
+   inbetweens.swap(sortedTargets);
+
+   mBreaks.clear();
+   mShapes.clear();
+   mInvSpans.clear();
+
+   mBreaks.push_back(0.0f);
+   mShapes.push_back(-1);
+   for(size_t k = 0; k < inbetweenWeights.size(); k++)
+   {
+      mBreaks.push_back(inbetweenWeights[k]);
+      mShapes.push_back((int)k);
+   }
+   mBreaks.push_back(1.0f);
+   mShapes.push_back((int)inbetweens.size());
+
+   for(size_t k = 0; k + 1 < mBreaks.size(); k++)
+      mInvSpans.push_back(1.0f / (mBreaks[k+1] - mBreaks[k]));
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method tells whether parent is driven by a strict subset of the
+//      weights of this item, so its deltas are part of this item's shape.
+//
+bool MorpheItem::DependsOn(const MorpheItem &parent) const
+{
+   if(parent.weightIds.empty() || parent.weightIds.size() >= weightIds.size())
+      return false;
+   return std::includes(weightIds.begin(), weightIds.end(), parent.weightIds.begin(), parent.weightIds.end());
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method turns the full deltas of a combination shape into deltas
+//      relative to its parents. Parents must already be relative themselves,
+//      so items are processed by increasing weight count, and have their
+//      segments built.
+//
+//      The shape at weight 1 is relative to every parent at weight 1. An
+//      in-between at weight w is reached when the product of the n weights
+//      of the item is w, so it is taken as sculpted with each of them at
+//      w^(1/n): a parent driven by m of them is subtracted as it evaluates
+//      at w^(m/n), through its own in-betweens.
+//
+void MorpheItem::MakeCorrective(const std::vector<const MorpheItem*> &items, float threshold)
+{
+   if(!IsCombination())
+      return;
+
+   MorpheTermArray terms;
+   for(size_t i = 0; i < items.size(); i++)
+   {
+      const MorpheItem *pParent = items[i];
+      if(pParent == this || !DependsOn(*pParent))
+         continue;
+
+      target.Subtract(pParent->target, 1.0f, threshold);
+
+      float fExponent = (float)pParent->weightIds.size() / (float)weightIds.size();
+      for(size_t k = 0; k < inbetweens.size(); k++)
+      {
+         float wt = inbetweenWeights[k];
+         wt = wt < 0.0f ? -powf(-wt, fExponent) : powf(wt, fExponent);
+
+         terms.clear();
+         pParent->GetTerms(wt, 1.0f, terms);
+         for(size_t t = 0; t < terms.size(); t++)
+            inbetweens[k].Subtract(*terms[t].target, terms[t].weight, threshold);
+      }
+   }
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method scales every shape of the item by per vertex weights.
+//
+void MorpheItem::ApplyWeights(const unsigned int *pIndices, const float *pValues, unsigned int uCount, float threshold)
+{
+   target.ApplyWeights(pIndices, pValues, uCount, threshold);
+   for(size_t k = 0; k < inbetweens.size(); k++)
+      inbetweens[k].ApplyWeights(pIndices, pValues, uCount, threshold);
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method quantizes every shape of the item, see
+//      MorpheTarget::Quantize.
+//
+// Return Values:
+//    the largest error of the quantized shapes
+//
+float MorpheItem::Quantize()
+{
+   float fError = target.Quantize();
+   for(size_t k = 0; k < inbetweens.size(); k++)
+   {
+      float fShapeError = inbetweens[k].Quantize();
+      if(fShapeError > fError)
+         fError = fShapeError;
+   }
+   return fError;
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method returns the largest error of the quantized shapes.
+//
+float MorpheItem::QuantizeError() const
+{
+   float fError = target.qError;
+   for(size_t k = 0; k < inbetweens.size(); k++)
+   {
+      if(inbetweens[k].qError > fError)
+         fError = inbetweens[k].qError;
+   }
+   return fError;
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method adds the shapes to accumulate for a weight: the two shapes
+//      around it, blended linearly. Weights outside [0, 1] extrapolate the
+//      first or last segment. scale multiplies the result (envelope).
+//
+void MorpheItem::GetTerms(float wt, float scale, MorpheTermArray &terms) const
+{
+   MorpheTerm term;
+
+   if(mBreaks.size() < 3)
+   {
+      // No in-between
+      term.target = &target;
+      term.weight = wt * scale;
+      terms.push_back(term);
+      return;
+   }
+
+   size_t k = std::upper_bound(mBreaks.begin(), mBreaks.end(), wt) - mBreaks.begin();
+   k = k == 0 ? 0 : k - 1;
+   if(k > mBreaks.size() - 2)
+      k = mBreaks.size() - 2;
+
+   float t = (wt - mBreaks[k]) * mInvSpans[k];
+
+   const MorpheTarget *pLow  = Shape(mShapes[k]);
+   const MorpheTarget *pHigh = Shape(mShapes[k+1]);
+   if(pLow != NULL && t != 1.0f)
+   {
+      term.target = pLow;
+      term.weight = (1.0f - t) * scale;
+      terms.push_back(term);
+   }
+   if(t != 0.0f)
+   {
+      term.target = pHigh;
+      term.weight = t * scale;
+      terms.push_back(term);
+   }
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method returns the bytes held by the shapes of the item.
+//
+size_t MorpheItem::MemorySize() const
+{
+   size_t uSize = target.MemorySize();
+   for(size_t k = 0; k < inbetweens.size(); k++)
+      uSize += inbetweens[k].MemorySize();
+   return uSize;
+}
+// -----------------------------------------------------------------------------
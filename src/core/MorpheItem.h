@@ -0,0 +1,64 @@
+// -----------------------------------------------------------------------------
+// MorpheItem.h - C++ File
+// -----------------------------------------------------------------------------
+
+#ifndef MORPHE_ITEM_H
+#define MORPHE_ITEM_H
+
+
+//
+// Includes
+//
+#include "MorpheAccumulator.h"
+#include "MorpheTarget.h"
+
+#include <map>
+#include <vector>
+// -----------------------------------------------------------------------------
+
+
+//
+// MorpheItem - A target driven by the product of one or more weights. Items
+//    with several weights are combination shapes whose deltas are stored
+//    relative to the sum of their parents: every item driven by a strict
+//    subset of their weights.
+//
+//    In-betweens are extra targets reached at weights between 0 and 1. The
+//    weight is looked up in a sorted segment table and only the two shapes
+//    around it are blended.
+//
+class MorpheItem
+{
+public:
+   void           SetWeightIds(const int *pIds, unsigned int uCount);
+   MorpheTarget   &AddInbetween(float wt);
+   void           BuildSegments();
+
+   bool           IsCombination() const            { return weightIds.size() > 1; }
+   bool           DependsOn(const MorpheItem &parent) const;
+   void           MakeCorrective(const std::vector<const MorpheItem*> &items, float threshold);
+   void           ApplyWeights(const unsigned int *pIndices, const float *pValues, unsigned int uCount, float threshold);
+   float          Quantize();
+   float          QuantizeError() const;
+
+   void           GetTerms(float wt, float scale, MorpheTermArray &terms) const;
+   size_t         MemorySize() const;
+
+public:
+   std::vector<int>           weightIds;           // Ascending, no duplicates
+   MorpheTarget               target;              // Shape at weight 1
+   std::vector<float>         inbetweenWeights;    // Ascending once segments are built
+   std::vector<MorpheTarget>  inbetweens;          // Shape at each in-between weight
+
+private:
+   const MorpheTarget   *Shape(int iShape) const  { return iShape < 0 ? NULL : (iShape < (int)inbetweens.size() ? &inbetweens[iShape] : &target); }
+
+   std::vector<float>         mBreaks;             // 0, in-between weights, 1
+   std::vector<float>         mInvSpans;           // 1 / length of each segment
+   std::vector<int>           mShapes;             // Shape at each break, -1 for the base
+};
+
+typedef std::map<unsigned int, MorpheItem> MorpheItemMap;   // Item index -> item
+// -----------------------------------------------------------------------------
+
+#endif
@@ -0,0 +1,352 @@
+// -----------------------------------------------------------------------------
+// MorpheItemStream.cpp - C++ File
+// -----------------------------------------------------------------------------
+
+
+//
+// Includes
+//
+#include "MorpheItemStream.h"
+
+#include <algorithm>
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    Constructor. The prefetch thread is started on the first prefetch.
+//
+MorpheItemStream::MorpheItemStream()
+   : mpLibrary(NULL), mBudget(0), mSize(0), mEvictions(0), mLoads(0), mPrefetches(0), mLoading(-1), mStop(false)
+{
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    Destructor.
+//
+MorpheItemStream::~MorpheItemStream()
+{
+   {
+      std::lock_guard<std::mutex> lock(mMutex);
+      mStop = true;
+      mQueue.clear();
+   }
+   mWake.notify_all();
+   if(mThread.joinable())
+      mThread.join();
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method drops every item and streams from another library, NULL
+//      for none. It returns once the prefetch thread no longer reads the
+//      previous library, so that library may be closed right after.
+//
+void MorpheItemStream::Reset(const MorpheLibrary *pLibrary)
+{
+   {
+      std::unique_lock<std::mutex> lock(mMutex);
+      mQueue.clear();
+      while(mLoading >= 0)
+         mDone.wait(lock);
+      mPrefetched.clear();
+      mpLibrary = pLibrary;
+   }
+
+   mResident.clear();
+   mUse.clear();
+   mSize = 0;
+   mRefused.clear();
+   mEvictions++;
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method reads an item from the library.
+//
+// Return Values:
+//    true if the library has the item
+//
+bool MorpheItemStream::Load(unsigned int uItemIdx, MorpheItem &item) const
+{
+   if(mpLibrary == NULL || !mpLibrary->IsOpen())
+      return false;
+
+   int iRecord = mpLibrary->Find(uItemIdx);
+   return iRecord >= 0 && mpLibrary->Load((unsigned int)iRecord, item);
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method makes an item resident, as the most recently used.
+//
+MorpheItemStream::Resident &MorpheItemStream::Insert(unsigned int uItemIdx, MorpheItem &item)
+{
+   Resident &resident = mResident[uItemIdx];
+   resident.item   = std::move(item);
+   resident.loaded = true;
+   mUse.push_front(uItemIdx);
+   resident.use    = mUse.begin();
+   mSize += resident.item.MemorySize();
+   mRefused.erase(uItemIdx);
+   return resident;
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method removes a resident item.
+//
+void MorpheItemStream::Evict(std::map<unsigned int, Resident>::iterator it)
+{
+   mSize -= it->second.item.MemorySize();
+   mUse.erase(it->second.use);
+   mResident.erase(it);
+   mEvictions++;
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method evicts the least recently used items outside of the
+//      window until uBytes more fit in the budget.
+//
+// Return Values:
+//    true if they fit
+//
+bool MorpheItemStream::Trim(size_t uBytes)
+{
+   std::list<unsigned int>::iterator itUse = mUse.end();
+   while(mSize + uBytes > mBudget && itUse != mUse.begin())
+   {
+      itUse--;
+      if(mWanted.count(*itUse))
+         continue;
+
+      std::list<unsigned int>::iterator itNext = itUse;
+      itNext++;
+      Evict(mResident.find(*itUse));
+      itUse = itNext;
+   }
+   return mSize + uBytes <= mBudget;
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method makes the items loaded by the prefetch thread resident,
+//      nearest in the window first, as long as they fit in the budget.
+//      bEvict allows evicting items outside of the window to make room;
+//      it is off while item pointers given by Get must stay valid. The
+//      items that do not fit are refused, and queued again by Update once
+//      there is room for them.
+//
+void MorpheItemStream::CollectPrefetched(bool bEvict)
+{
+   std::lock_guard<std::mutex> lock(mMutex);
+   if(mPrefetched.empty())
+      return;
+
+   std::vector<unsigned int> order;
+   for(size_t w = 0; w < mWindow.size(); w++)
+   {
+      if(mPrefetched.count(mWindow[w]))
+         order.push_back(mWindow[w]);
+   }
+
+   for(size_t k = 0; k < order.size(); k++)
+   {
+      MorpheItem &item = mPrefetched[order[k]];
+      if(mResident.count(order[k]))
+         continue;
+
+      size_t uBytes = item.MemorySize();
+      if(bEvict ? Trim(uBytes) : mSize + uBytes <= mBudget)
+      {
+         Insert(order[k], item);
+         mPrefetches++;
+      }
+      else
+         mRefused[order[k]] = uBytes;
+   }
+
+   // Items no longer in the window are not kept
+   mPrefetched.clear();
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method takes the items wanted soon, nearest first. Least recently
+//      used items outside of them are evicted until the stream fits in its
+//      budget, then the missing ones are queued for the prefetch thread.
+//
+void MorpheItemStream::Update(const std::vector<unsigned int> &window)
+{
+   mWindow = window;
+   mWanted = std::set<unsigned int>(window.begin(), window.end());
+
+   CollectPrefetched(true);
+   Trim(0);
+
+   // Room left once every item outside of the window is evicted
+   size_t uKept = 0;
+   for(std::map<unsigned int, Resident>::const_iterator it = mResident.begin(); it != mResident.end(); it++)
+   {
+      if(mWanted.count(it->first))
+         uKept += it->second.item.MemorySize();
+   }
+   size_t uRoom = uKept < mBudget ? mBudget - uKept : 0;
+
+   {
+      std::lock_guard<std::mutex> lock(mMutex);
+      std::set<unsigned int> queued;
+      mQueue.clear();
+      for(size_t w = 0; w < window.size(); w++)
+      {
+         unsigned int uItemIdx = window[w];
+         if(mResident.count(uItemIdx) || mPrefetched.count(uItemIdx) || mLoading == (int)uItemIdx || !queued.insert(uItemIdx).second)
+            continue;
+
+         // A refused item is loaded again only if it fits now
+         std::map<unsigned int, size_t>::iterator itRefused = mRefused.find(uItemIdx);
+         if(itRefused != mRefused.end())
+         {
+            if(itRefused->second > uRoom)
+               continue;
+            uRoom -= itRefused->second;
+            mRefused.erase(itRefused);
+         }
+         mQueue.push_back(uItemIdx);
+      }
+
+      // Refused items that left the window are tried again if they return
+      for(std::map<unsigned int, size_t>::iterator it = mRefused.begin(); it != mRefused.end(); )
+      {
+         if(mWanted.count(it->first))
+            it++;
+         else
+            mRefused.erase(it++);
+      }
+      if(mQueue.empty())
+         return;
+      if(!mThread.joinable())
+         mThread = std::thread(&MorpheItemStream::WorkerLoop, this);
+   }
+   mWake.notify_one();
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method returns an item, loading it now if it was not prefetched.
+//      bLoaded tells whether the item is returned for the first time since
+//      it was loaded.
+//
+// Return Values:
+//    the item, NULL if the library does not have it
+//
+MorpheItem *MorpheItemStream::Get(unsigned int uItemIdx, bool &bLoaded)
+{
+   std::map<unsigned int, Resident>::iterator it = mResident.find(uItemIdx);
+   if(it == mResident.end())
+   {
+      // Not queued anymore, or being loaded right now. The item is kept
+      // whatever the budget, the others are collected if they fit.
+      MorpheItem item;
+      bool bPrefetched = false;
+      {
+         std::unique_lock<std::mutex> lock(mMutex);
+         std::deque<unsigned int>::iterator itQueue = std::find(mQueue.begin(), mQueue.end(), uItemIdx);
+         if(itQueue != mQueue.end())
+            mQueue.erase(itQueue);
+         while(mLoading == (int)uItemIdx)
+            mDone.wait(lock);
+
+         std::map<unsigned int, MorpheItem>::iterator itPrefetched = mPrefetched.find(uItemIdx);
+         if(itPrefetched != mPrefetched.end())
+         {
+            item = std::move(itPrefetched->second);
+            mPrefetched.erase(itPrefetched);
+            bPrefetched = true;
+         }
+      }
+      CollectPrefetched(false);
+
+      if(bPrefetched)
+         mPrefetches++;
+      else if(Load(uItemIdx, item))
+         mLoads++;
+      else
+         return NULL;
+      Insert(uItemIdx, item);
+      it = mResident.find(uItemIdx);
+   }
+
+   Resident &resident = it->second;
+   mUse.splice(mUse.begin(), mUse, resident.use);
+   bLoaded = resident.loaded;
+   resident.loaded = false;
+   return &resident.item;
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method evicts an item, it is loaded again on its next use.
+//
+void MorpheItemStream::Drop(unsigned int uItemIdx)
+{
+   std::map<unsigned int, Resident>::iterator it = mResident.find(uItemIdx);
+   if(it != mResident.end())
+      Evict(it);
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method loads the queued items, nearest first, until stopped.
+//
+void MorpheItemStream::WorkerLoop()
+{
+   std::unique_lock<std::mutex> lock(mMutex);
+   while(!mStop)
+   {
+      if(mQueue.empty())
+      {
+         mWake.wait(lock);
+         continue;
+      }
+
+      unsigned int uItemIdx = mQueue.front();
+      mQueue.pop_front();
+      mLoading = (int)uItemIdx;
+      lock.unlock();
+
+      MorpheItem item;
+      bool bOk = Load(uItemIdx, item);
+
+      lock.lock();
+      if(bOk)
+         mPrefetched[uItemIdx] = std::move(item);
+      mLoading = -1;
+      mDone.notify_all();
+   }
+}
+// -----------------------------------------------------------------------------
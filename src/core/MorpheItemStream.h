@@ -0,0 +1,99 @@
+// -----------------------------------------------------------------------------
+// MorpheItemStream.h - C++ File
+// -----------------------------------------------------------------------------
+
+#ifndef MORPHE_ITEM_STREAM_H
+#define MORPHE_ITEM_STREAM_H
+
+
+//
+// Includes
+//
+#include "MorpheItem.h"
+#include "MorpheLibrary.h"
+
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <map>
+#include <mutex>
+#include <set>
+#include <stddef.h>
+#include <thread>
+#include <vector>
+// -----------------------------------------------------------------------------
+
+
+//
+// MorpheItemStream - Library items loaded on demand and kept under a memory
+//    budget. The items wanted soon are given to Update, which has a
+//    background thread prefetch the missing ones and evicts the least
+//    recently used others once over budget. Prefetched items are only kept
+//    if they fit in the budget, nearest first. Get loads an item that was
+//    not prefetched in time.
+//
+//    Update, Get, Drop and Reset are called from one thread. Item pointers
+//    stay valid until Update evicts the item, Drop or Reset; Evictions
+//    changes whenever one does.
+//
+class MorpheItemStream
+{
+public:
+                  MorpheItemStream();
+                  ~MorpheItemStream();
+
+   void           Reset(const MorpheLibrary *pLibrary);
+   void           SetBudget(size_t uBytes)         { mBudget = uBytes; }
+   void           Update(const std::vector<unsigned int> &window);
+   MorpheItem     *Get(unsigned int uItemIdx, bool &bLoaded);
+   void           Drop(unsigned int uItemIdx);
+
+   unsigned int   ResidentCount() const            { return (unsigned int)mResident.size(); }
+   size_t         MemorySize() const               { return mSize; }
+   unsigned int   Evictions() const                { return mEvictions; }
+   unsigned int   Loads() const                    { return mLoads; }
+   unsigned int   Prefetches() const               { return mPrefetches; }
+
+private:
+                  MorpheItemStream(const MorpheItemStream&);
+   MorpheItemStream &operator=(const MorpheItemStream&);
+
+   struct Resident
+   {
+      MorpheItem                          item;
+      bool                                loaded;     // Get has not returned it yet
+      std::list<unsigned int>::iterator   use;
+   };
+
+   bool           Load(unsigned int uItemIdx, MorpheItem &item) const;
+   Resident       &Insert(unsigned int uItemIdx, MorpheItem &item);
+   void           Evict(std::map<unsigned int, Resident>::iterator it);
+   bool           Trim(size_t uBytes);
+   void           CollectPrefetched(bool bEvict);
+   void           WorkerLoop();
+
+   const MorpheLibrary                 *mpLibrary;
+   size_t                              mBudget;
+   std::map<unsigned int, Resident>    mResident;
+   std::list<unsigned int>             mUse;          // Most recently used first
+   size_t                              mSize;         // Of the resident items
+   std::vector<unsigned int>           mWindow;       // Given to the last Update
+   std::set<unsigned int>              mWanted;       // Items of mWindow
+   std::map<unsigned int, size_t>      mRefused;      // Prefetched, did not fit
+   unsigned int                        mEvictions;
+   unsigned int                        mLoads;        // Loaded by Get
+   unsigned int                        mPrefetches;   // Loaded ahead by the thread
+
+   // Shared with the prefetch thread
+   std::thread                         mThread;
+   std::mutex                          mMutex;
+   std::condition_variable             mWake;
+   std::condition_variable             mDone;
+   std::deque<unsigned int>            mQueue;
+   std::map<unsigned int, MorpheItem>  mPrefetched;   // Loaded, not collected yet
+   int                                 mLoading;      // Item being loaded, -1 if none
+   bool                                mStop;
+};
+// -----------------------------------------------------------------------------
+
+#endif
@@ -0,0 +1,187 @@
+// -----------------------------------------------------------------------------
+// MorpheKernels.cpp - C++ File
+// -----------------------------------------------------------------------------
+
+
+//
+// Includes
+//
+#include "MorpheKernels.h"
+
+#include <atomic>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(MORPHE_X86) && defined(_MSC_VER)
+#include <intrin.h>
+#endif
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    Portable kernels, also used for the tails of the SIMD ones.
+//
+static void AccumulateSparseScalar(float *pX, float *pY, float *pZ, const unsigned int *pIndices,
+                                   const float *pDX, const float *pDY, const float *pDZ, float wt, unsigned int uCount)
+{
+   for(unsigned int k = 0; k < uCount; k++)
+   {
+      unsigned int j = pIndices[k];
+      pX[j] += pDX[k] * wt;
+      pY[j] += pDY[k] * wt;
+      pZ[j] += pDZ[k] * wt;
+   }
+}
+
+static void AccumulateDenseScalar(float *pDst, const float *pSrc, float wt, unsigned int uCount)
+{
+   for(unsigned int k = 0; k < uCount; k++)
+      pDst[k] += pSrc[k] * wt;
+}
+
+static void AccumulateSparseQScalar(float *pX, float *pY, float *pZ, const unsigned int *pIndices,
+                                    const unsigned short *pQX, const unsigned short *pQY, const unsigned short *pQZ,
+                                    const float *pOffset, const float *pScale, unsigned int uCount)
+{
+   for(unsigned int k = 0; k < uCount; k++)
+   {
+      unsigned int j = pIndices[k];
+      pX[j] += pQX[k] * pScale[0] + pOffset[0];
+      pY[j] += pQY[k] * pScale[1] + pOffset[1];
+      pZ[j] += pQZ[k] * pScale[2] + pOffset[2];
+   }
+}
+
+static void AccumulateDenseQScalar(float *pDst, const unsigned short *pSrc, float offset, float scale, unsigned int uCount)
+{
+   for(unsigned int k = 0; k < uCount; k++)
+      pDst[k] += pSrc[k] * scale + offset;
+}
+
+const MorpheKernels gMorpheKernelsScalar = { "scalar", AccumulateSparseScalar, AccumulateDenseScalar, AccumulateSparseQScalar, AccumulateDenseQScalar };
+// -----------------------------------------------------------------------------
+
+
+#ifdef MORPHE_X86
+//
+// Description:
+//    This method tells whether the CPU and the OS support AVX2 and FMA.
+//
+static bool DetectAVX2()
+{
+#if defined(_MSC_VER)
+   int info[4];
+   __cpuid(info, 1);
+   bool bOSXSave = (info[2] & (1 << 27)) != 0;
+   bool bFMA     = (info[2] & (1 << 12)) != 0;
+   if(!bOSXSave || !bFMA || (_xgetbv(0) & 0x6) != 0x6)
+      return false;
+   __cpuidex(info, 7, 0);
+   return (info[1] & (1 << 5)) != 0;
+#elif defined(__GNUC__)
+   __builtin_cpu_init();
+   return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#else
+   return false;
+#endif
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method returns DetectAVX2, queried once whatever the thread.
+//
+static bool HasAVX2()
+{
+   static const bool bAVX2 = DetectAVX2();
+   return bAVX2;
+}
+#endif
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method finds a kernel set by name.
+//
+// Return Values:
+//    the kernels, NULL if the name is unknown or not supported by this CPU
+//
+static const MorpheKernels *FindKernels(const char *name)
+{
+   if(strcmp(name, gMorpheKernelsScalar.name) == 0)
+      return &gMorpheKernelsScalar;
+#ifdef MORPHE_X86
+   if(strcmp(name, gMorpheKernelsSSE.name) == 0)
+      return &gMorpheKernelsSSE;
+   if(strcmp(name, gMorpheKernelsAVX2.name) == 0 && HasAVX2())
+      return &gMorpheKernelsAVX2;
+#endif
+   return NULL;
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method returns the best kernels for this CPU. MORPHE_KERNELS
+//      overrides the choice with any name MorpheSelectKernels accepts.
+//
+static const MorpheKernels *DetectKernels()
+{
+   const char *pForced = getenv("MORPHE_KERNELS");
+   const MorpheKernels *pKernels = pForced != NULL ? FindKernels(pForced) : NULL;
+   if(pKernels != NULL)
+      return pKernels;
+
+#ifdef MORPHE_X86
+   return HasAVX2() ? &gMorpheKernelsAVX2 : &gMorpheKernelsSSE;
+#else
+   return &gMorpheKernelsScalar;
+#endif
+}
+
+// Read by every accumulation thread, set once by the first of them or by
+// MorpheSelectKernels
+static std::atomic<const MorpheKernels*> gpKernels(NULL);
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method returns the kernels selected for this process. Threads
+//      racing on the first call detect the same kernels, the first one
+//      stored is kept.
+//
+const MorpheKernels &MorpheGetKernels()
+{
+   const MorpheKernels *pKernels = gpKernels.load(std::memory_order_acquire);
+   if(pKernels == NULL)
+   {
+      const MorpheKernels *pDetected = DetectKernels();
+      pKernels = gpKernels.compare_exchange_strong(pKernels, pDetected, std::memory_order_acq_rel) ? pDetected : pKernels;
+   }
+   return *pKernels;
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method forces a kernel set by name.
+//
+// Return Values:
+//    false if the name is unknown or not supported by this CPU
+//
+bool MorpheSelectKernels(const char *name)
+{
+   const MorpheKernels *pKernels = FindKernels(name);
+   if(pKernels == NULL)
+      return false;
+
+   gpKernels.store(pKernels, std::memory_order_release);
+   return true;
+}
+// -----------------------------------------------------------------------------
@@ -0,0 +1,71 @@
+// -----------------------------------------------------------------------------
+// MorpheKernels.h - C++ File
+// -----------------------------------------------------------------------------
+
+#ifndef MORPHE_KERNELS_H
+#define MORPHE_KERNELS_H
+
+
+//
+// Includes
+//
+#include <stddef.h>
+// -----------------------------------------------------------------------------
+
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define MORPHE_X86
+#endif
+// -----------------------------------------------------------------------------
+
+
+//
+// Kernel signatures
+//
+// pX[pIndices[k]] += pDX[k] * wt, same for y and z
+typedef void (*MorpheSparseKernel)(float *pX, float *pY, float *pZ, const unsigned int *pIndices,
+                                   const float *pDX, const float *pDY, const float *pDZ, float wt, unsigned int uCount);
+
+// pDst[k] += pSrc[k] * wt
+typedef void (*MorpheDenseKernel)(float *pDst, const float *pSrc, float wt, unsigned int uCount);
+
+// pX[pIndices[k]] += pQX[k] * pScale[0] + pOffset[0], same for y and z
+typedef void (*MorpheSparseQKernel)(float *pX, float *pY, float *pZ, const unsigned int *pIndices,
+                                    const unsigned short *pQX, const unsigned short *pQY, const unsigned short *pQZ,
+                                    const float *pOffset, const float *pScale, unsigned int uCount);
+
+// pDst[k] += pSrc[k] * scale + offset
+typedef void (*MorpheDenseQKernel)(float *pDst, const unsigned short *pSrc, float offset, float scale, unsigned int uCount);
+// -----------------------------------------------------------------------------
+
+
+//
+// MorpheKernels - Accumulation kernels of one instruction set. The Q kernels
+//    expand quantized deltas on the fly, offset and scale already carry the
+//    weight.
+//
+struct MorpheKernels
+{
+   const char           *name;
+   MorpheSparseKernel   AccumulateSparse;
+   MorpheDenseKernel    AccumulateDense;
+   MorpheSparseQKernel  AccumulateSparseQ;
+   MorpheDenseQKernel   AccumulateDenseQ;
+};
+// -----------------------------------------------------------------------------
+
+
+//
+// Functions
+//
+const MorpheKernels  &MorpheGetKernels();
+bool                 MorpheSelectKernels(const char *name);
+
+extern const MorpheKernels gMorpheKernelsScalar;
+#ifdef MORPHE_X86
+extern const MorpheKernels gMorpheKernelsSSE;
+extern const MorpheKernels gMorpheKernelsAVX2;
+#endif
+// -----------------------------------------------------------------------------
+
+#endif
@@ -0,0 +1,129 @@
+// -----------------------------------------------------------------------------
+// MorpheKernelsAVX2.cpp - C++ File
+//    Must be compiled with AVX2 and FMA enabled (-mavx2 -mfma, /arch:AVX2).
+// -----------------------------------------------------------------------------
+
+
+//
+// Includes
+//
+#include "MorpheKernels.h"
+
+#ifdef MORPHE_X86
+#include <immintrin.h>
+#include <math.h>
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    AVX2 kernels. Tails use fmaf so every element is rounded the same way
+//      whatever its position in the range.
+//
+static void AccumulateSparseAVX2(float *pX, float *pY, float *pZ, const unsigned int *pIndices,
+                                 const float *pDX, const float *pDY, const float *pDZ, float wt, unsigned int uCount)
+{
+   __m256 w = _mm256_set1_ps(wt);
+   float  fx[8], fy[8], fz[8];
+
+   unsigned int k = 0;
+   for(; k + 8 <= uCount; k += 8)
+   {
+      // Indices of a target are unique, so gathering before the scalar
+      // scatter cannot miss an update of the same vertex.
+      __m256i idx = _mm256_loadu_si256((const __m256i*)(pIndices + k));
+      _mm256_storeu_ps(fx, _mm256_fmadd_ps(_mm256_loadu_ps(pDX + k), w, _mm256_i32gather_ps(pX, idx, 4)));
+      _mm256_storeu_ps(fy, _mm256_fmadd_ps(_mm256_loadu_ps(pDY + k), w, _mm256_i32gather_ps(pY, idx, 4)));
+      _mm256_storeu_ps(fz, _mm256_fmadd_ps(_mm256_loadu_ps(pDZ + k), w, _mm256_i32gather_ps(pZ, idx, 4)));
+      for(unsigned int n = 0; n < 8; n++)
+      {
+         unsigned int j = pIndices[k + n];
+         pX[j] = fx[n];
+         pY[j] = fy[n];
+         pZ[j] = fz[n];
+      }
+   }
+   for(; k < uCount; k++)
+   {
+      unsigned int j = pIndices[k];
+      pX[j] = fmaf(pDX[k], wt, pX[j]);
+      pY[j] = fmaf(pDY[k], wt, pY[j]);
+      pZ[j] = fmaf(pDZ[k], wt, pZ[j]);
+   }
+}
+
+static void AccumulateDenseAVX2(float *pDst, const float *pSrc, float wt, unsigned int uCount)
+{
+   __m256 w = _mm256_set1_ps(wt);
+
+   unsigned int k = 0;
+   for(; k + 16 <= uCount; k += 16)
+   {
+      __m256 a = _mm256_fmadd_ps(_mm256_loadu_ps(pSrc + k),     w, _mm256_loadu_ps(pDst + k));
+      __m256 b = _mm256_fmadd_ps(_mm256_loadu_ps(pSrc + k + 8), w, _mm256_loadu_ps(pDst + k + 8));
+      _mm256_storeu_ps(pDst + k,     a);
+      _mm256_storeu_ps(pDst + k + 8, b);
+   }
+   for(; k < uCount; k++)
+      pDst[k] = fmaf(pSrc[k], wt, pDst[k]);
+}
+
+// Eight quantized deltas to floats
+static inline __m256 LoadQAVX2(const unsigned short *pSrc)
+{
+   return _mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)pSrc)));
+}
+
+static void AccumulateSparseQAVX2(float *pX, float *pY, float *pZ, const unsigned int *pIndices,
+                                  const unsigned short *pQX, const unsigned short *pQY, const unsigned short *pQZ,
+                                  const float *pOffset, const float *pScale, unsigned int uCount)
+{
+   __m256 ox = _mm256_set1_ps(pOffset[0]), oy = _mm256_set1_ps(pOffset[1]), oz = _mm256_set1_ps(pOffset[2]);
+   __m256 sx = _mm256_set1_ps(pScale[0]),  sy = _mm256_set1_ps(pScale[1]),  sz = _mm256_set1_ps(pScale[2]);
+   float  fx[8], fy[8], fz[8];
+
+   unsigned int k = 0;
+   for(; k + 8 <= uCount; k += 8)
+   {
+      __m256i idx = _mm256_loadu_si256((const __m256i*)(pIndices + k));
+      _mm256_storeu_ps(fx, _mm256_add_ps(_mm256_fmadd_ps(LoadQAVX2(pQX + k), sx, ox), _mm256_i32gather_ps(pX, idx, 4)));
+      _mm256_storeu_ps(fy, _mm256_add_ps(_mm256_fmadd_ps(LoadQAVX2(pQY + k), sy, oy), _mm256_i32gather_ps(pY, idx, 4)));
+      _mm256_storeu_ps(fz, _mm256_add_ps(_mm256_fmadd_ps(LoadQAVX2(pQZ + k), sz, oz), _mm256_i32gather_ps(pZ, idx, 4)));
+      for(unsigned int n = 0; n < 8; n++)
+      {
+         unsigned int j = pIndices[k + n];
+         pX[j] = fx[n];
+         pY[j] = fy[n];
+         pZ[j] = fz[n];
+      }
+   }
+   for(; k < uCount; k++)
+   {
+      unsigned int j = pIndices[k];
+      pX[j] += fmaf((float)pQX[k], pScale[0], pOffset[0]);
+      pY[j] += fmaf((float)pQY[k], pScale[1], pOffset[1]);
+      pZ[j] += fmaf((float)pQZ[k], pScale[2], pOffset[2]);
+   }
+}
+
+static void AccumulateDenseQAVX2(float *pDst, const unsigned short *pSrc, float offset, float scale, unsigned int uCount)
+{
+   __m256 o = _mm256_set1_ps(offset);
+   __m256 s = _mm256_set1_ps(scale);
+
+   unsigned int k = 0;
+   for(; k + 16 <= uCount; k += 16)
+   {
+      __m256 a = _mm256_add_ps(_mm256_loadu_ps(pDst + k),     _mm256_fmadd_ps(LoadQAVX2(pSrc + k),     s, o));
+      __m256 b = _mm256_add_ps(_mm256_loadu_ps(pDst + k + 8), _mm256_fmadd_ps(LoadQAVX2(pSrc + k + 8), s, o));
+      _mm256_storeu_ps(pDst + k,     a);
+      _mm256_storeu_ps(pDst + k + 8, b);
+   }
+   for(; k < uCount; k++)
+      pDst[k] += fmaf((float)pSrc[k], scale, offset);
+}
+
+const MorpheKernels gMorpheKernelsAVX2 = { "avx2", AccumulateSparseAVX2, AccumulateDenseAVX2, AccumulateSparseQAVX2, AccumulateDenseQAVX2 };
+// -----------------------------------------------------------------------------
+
+#endif
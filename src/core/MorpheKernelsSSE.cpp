@@ -0,0 +1,124 @@
+// -----------------------------------------------------------------------------
+// MorpheKernelsSSE.cpp - C++ File
+// -----------------------------------------------------------------------------
+
+
+//
+// Includes
+//
+#include "MorpheKernels.h"
+
+#ifdef MORPHE_X86
+#include <emmintrin.h>
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    SSE2 kernels. Scattered writes stay scalar, only the weighting of the
+//      deltas is vectorized.
+//
+static void AccumulateSparseSSE(float *pX, float *pY, float *pZ, const unsigned int *pIndices,
+                                const float *pDX, const float *pDY, const float *pDZ, float wt, unsigned int uCount)
+{
+   __m128 w = _mm_set1_ps(wt);
+   float  fx[4], fy[4], fz[4];
+
+   unsigned int k = 0;
+   for(; k + 4 <= uCount; k += 4)
+   {
+      _mm_storeu_ps(fx, _mm_mul_ps(_mm_loadu_ps(pDX + k), w));
+      _mm_storeu_ps(fy, _mm_mul_ps(_mm_loadu_ps(pDY + k), w));
+      _mm_storeu_ps(fz, _mm_mul_ps(_mm_loadu_ps(pDZ + k), w));
+      for(unsigned int n = 0; n < 4; n++)
+      {
+         unsigned int j = pIndices[k + n];
+         pX[j] += fx[n];
+         pY[j] += fy[n];
+         pZ[j] += fz[n];
+      }
+   }
+   for(; k < uCount; k++)
+   {
+      unsigned int j = pIndices[k];
+      pX[j] += pDX[k] * wt;
+      pY[j] += pDY[k] * wt;
+      pZ[j] += pDZ[k] * wt;
+   }
+}
+
+static void AccumulateDenseSSE(float *pDst, const float *pSrc, float wt, unsigned int uCount)
+{
+   __m128 w = _mm_set1_ps(wt);
+
+   unsigned int k = 0;
+   for(; k + 8 <= uCount; k += 8)
+   {
+      __m128 a = _mm_add_ps(_mm_loadu_ps(pDst + k),     _mm_mul_ps(_mm_loadu_ps(pSrc + k),     w));
+      __m128 b = _mm_add_ps(_mm_loadu_ps(pDst + k + 4), _mm_mul_ps(_mm_loadu_ps(pSrc + k + 4), w));
+      _mm_storeu_ps(pDst + k,     a);
+      _mm_storeu_ps(pDst + k + 4, b);
+   }
+   for(; k < uCount; k++)
+      pDst[k] += pSrc[k] * wt;
+}
+
+// Four quantized deltas to floats
+static inline __m128 LoadQSSE(const unsigned short *pSrc)
+{
+   __m128i q = _mm_loadl_epi64((const __m128i*)pSrc);
+   return _mm_cvtepi32_ps(_mm_unpacklo_epi16(q, _mm_setzero_si128()));
+}
+
+static void AccumulateSparseQSSE(float *pX, float *pY, float *pZ, const unsigned int *pIndices,
+                                 const unsigned short *pQX, const unsigned short *pQY, const unsigned short *pQZ,
+                                 const float *pOffset, const float *pScale, unsigned int uCount)
+{
+   __m128 ox = _mm_set1_ps(pOffset[0]), oy = _mm_set1_ps(pOffset[1]), oz = _mm_set1_ps(pOffset[2]);
+   __m128 sx = _mm_set1_ps(pScale[0]),  sy = _mm_set1_ps(pScale[1]),  sz = _mm_set1_ps(pScale[2]);
+   float  fx[4], fy[4], fz[4];
+
+   unsigned int k = 0;
+   for(; k + 4 <= uCount; k += 4)
+   {
+      _mm_storeu_ps(fx, _mm_add_ps(_mm_mul_ps(LoadQSSE(pQX + k), sx), ox));
+      _mm_storeu_ps(fy, _mm_add_ps(_mm_mul_ps(LoadQSSE(pQY + k), sy), oy));
+      _mm_storeu_ps(fz, _mm_add_ps(_mm_mul_ps(LoadQSSE(pQZ + k), sz), oz));
+      for(unsigned int n = 0; n < 4; n++)
+      {
+         unsigned int j = pIndices[k + n];
+         pX[j] += fx[n];
+         pY[j] += fy[n];
+         pZ[j] += fz[n];
+      }
+   }
+   for(; k < uCount; k++)
+   {
+      unsigned int j = pIndices[k];
+      pX[j] += pQX[k] * pScale[0] + pOffset[0];
+      pY[j] += pQY[k] * pScale[1] + pOffset[1];
+      pZ[j] += pQZ[k] * pScale[2] + pOffset[2];
+   }
+}
+
+static void AccumulateDenseQSSE(float *pDst, const unsigned short *pSrc, float offset, float scale, unsigned int uCount)
+{
+   __m128 o = _mm_set1_ps(offset);
+   __m128 s = _mm_set1_ps(scale);
+
+   unsigned int k = 0;
+   for(; k + 8 <= uCount; k += 8)
+   {
+      __m128 a = _mm_add_ps(_mm_loadu_ps(pDst + k),     _mm_add_ps(_mm_mul_ps(LoadQSSE(pSrc + k),     s), o));
+      __m128 b = _mm_add_ps(_mm_loadu_ps(pDst + k + 4), _mm_add_ps(_mm_mul_ps(LoadQSSE(pSrc + k + 4), s), o));
+      _mm_storeu_ps(pDst + k,     a);
+      _mm_storeu_ps(pDst + k + 4, b);
+   }
+   for(; k < uCount; k++)
+      pDst[k] += pSrc[k] * scale + offset;
+}
+
+const MorpheKernels gMorpheKernelsSSE = { "sse", AccumulateSparseSSE, AccumulateDenseSSE, AccumulateSparseQSSE, AccumulateDenseQSSE };
+// -----------------------------------------------------------------------------
+
+#endif
@@ -0,0 +1,364 @@
+// -----------------------------------------------------------------------------
+// MorpheLibrary.cpp - C++ File
+// -----------------------------------------------------------------------------
+
+
+//
+// Includes
+//
+#include "MorpheLibrary.h"
+
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    Blocks are padded to 8 bytes so every offset stays aligned.
+//
+static unsigned long long PaddedSize(unsigned long long uSize)
+{
+   return (uSize + 7) & ~7ULL;
+}
+
+static bool WriteBlock(FILE *pFile, const void *pData, size_t uSize)
+{
+   static const char zeros[8] = { 0 };
+   size_t uPad = (size_t)(PaddedSize(uSize) - uSize);
+   if(uSize > 0 && fwrite(pData, 1, uSize, pFile) != uSize)
+      return false;
+   return uPad == 0 || fwrite(zeros, 1, uPad, pFile) == uPad;
+}
+
+static bool SortByIndex(const MorpheLibraryRecord &a, const MorpheLibraryRecord &b)
+{
+   return a.index < b.index;
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method writes items to a library file. Quantized shapes are
+//      stored expanded.
+//
+// Return Values:
+//    false if the file could not be written
+//
+bool MorpheWriteLibrary(const char *pPath, unsigned int uVertexCount, const std::vector<MorpheLibraryEntry> &entries)
+{
+   FILE *pFile = fopen(pPath, "wb");
+   if(pFile == NULL)
+      return false;
+
+   MorpheLibraryHeader header;
+   memset(&header, 0, sizeof(header));
+   memcpy(header.magic, MORPHE_LIBRARY_MAGIC, 4);
+   header.version     = MORPHE_LIBRARY_VERSION;
+   header.itemCount   = (unsigned int)entries.size();
+   header.vertexCount = uVertexCount;
+
+   bool bOk = WriteBlock(pFile, &header, sizeof(header));
+   unsigned long long uOffset = PaddedSize(sizeof(header));
+
+   std::vector<MorpheLibraryRecord> records;
+   for(size_t e = 0; e < entries.size() && bOk; e++)
+   {
+      const MorpheItem &item = *entries[e].item;
+
+      // Shapes in evaluation order, expanded if quantized
+      std::vector<MorpheTarget>  shapes;
+      std::vector<float>         shapeWeights;
+      for(size_t k = 0; k < item.inbetweens.size(); k++)
+      {
+         shapes.push_back(item.inbetweens[k]);
+         shapeWeights.push_back(item.inbetweenWeights[k]);
+      }
+      shapes.push_back(item.target);
+      shapeWeights.push_back(1.0f);
+
+      MorpheLibraryRecord record;
+      memset(&record, 0, sizeof(record));
+      record.index       = entries[e].index;
+      record.nameLength  = (unsigned int)entries[e].name.size();
+      record.weightCount = (unsigned int)item.weightIds.size();
+      record.shapeCount  = (unsigned int)shapes.size();
+
+      record.nameOffset  = uOffset;
+      bOk = bOk && WriteBlock(pFile, entries[e].name.c_str(), record.nameLength);
+      uOffset += PaddedSize(record.nameLength);
+
+      record.weightsOffset = uOffset;
+      bOk = bOk && WriteBlock(pFile, record.weightCount > 0 ? &item.weightIds[0] : NULL, record.weightCount * sizeof(int));
+      uOffset += PaddedSize(record.weightCount * sizeof(int));
+
+      // Shape table, then the data it points to
+      record.shapesOffset = uOffset;
+      uOffset += PaddedSize(shapes.size() * sizeof(MorpheLibraryShape));
+
+      std::vector<MorpheLibraryShape> table(shapes.size());
+      for(size_t k = 0; k < shapes.size(); k++)
+      {
+         shapes[k].Dequantize();
+         memset(&table[k], 0, sizeof(MorpheLibraryShape));
+         table[k].weight = shapeWeights[k];
+         table[k].count  = shapes[k].Count();
+         table[k].dense  = shapes[k].IsDense() ? 1 : 0;
+
+         table[k].indicesOffset = uOffset;
+         uOffset += PaddedSize(shapes[k].indices.size() * sizeof(unsigned int));
+         table[k].deltasOffset = uOffset;
+         uOffset += 3 * PaddedSize(table[k].count * sizeof(float));
+      }
+
+      bOk = bOk && WriteBlock(pFile, &table[0], table.size() * sizeof(MorpheLibraryShape));
+      for(size_t k = 0; k < shapes.size() && bOk; k++)
+      {
+         const MorpheTarget &shape = shapes[k];
+         size_t uBytes = shape.Count() * sizeof(float);
+         bOk = WriteBlock(pFile, shape.indices.empty() ? NULL : &shape.indices[0], shape.indices.size() * sizeof(unsigned int)) &&
+               WriteBlock(pFile, uBytes > 0 ? &shape.dx[0] : NULL, uBytes) &&
+               WriteBlock(pFile, uBytes > 0 ? &shape.dy[0] : NULL, uBytes) &&
+               WriteBlock(pFile, uBytes > 0 ? &shape.dz[0] : NULL, uBytes);
+      }
+
+      records.push_back(record);
+   }
+
+   // Record table, then the header again now that its offset is known
+   header.tableOffset = uOffset;
+   bOk = bOk && WriteBlock(pFile, records.empty() ? NULL : &records[0], records.size() * sizeof(MorpheLibraryRecord));
+   bOk = bOk && fseek(pFile, 0, SEEK_SET) == 0 && WriteBlock(pFile, &header, sizeof(header));
+   bOk = fclose(pFile) == 0 && bOk;
+   return bOk;
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Constructor / Destructor
+//
+MorpheLibrary::MorpheLibrary() : mpData(NULL), mSize(0), mhFile(NULL), mhMapping(NULL), mVertexCount(0) {}
+
+MorpheLibrary::~MorpheLibrary()
+{
+   Close();
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method maps a library file and reads its record table.
+//
+// Return Values:
+//    false if the file cannot be mapped or is not a valid library
+//
+bool MorpheLibrary::Open(const char *pPath)
+{
+   Close();
+
+#ifdef _WIN32
+   HANDLE hFile = CreateFileA(pPath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+   if(hFile == INVALID_HANDLE_VALUE)
+      return false;
+   LARGE_INTEGER size;
+   HANDLE hMapping = NULL;
+   if(GetFileSizeEx(hFile, &size) && size.QuadPart > 0)
+      hMapping = CreateFileMappingA(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+   if(hMapping == NULL)
+   {
+      CloseHandle(hFile);
+      return false;
+   }
+   mhFile    = hFile;
+   mhMapping = hMapping;
+   mSize     = (size_t)size.QuadPart;
+   mpData    = (const char*)MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0);
+#else
+   int fd = open(pPath, O_RDONLY);
+   if(fd < 0)
+      return false;
+   struct stat st;
+   void *pMap = MAP_FAILED;
+   if(fstat(fd, &st) == 0 && st.st_size > 0)
+      pMap = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+   close(fd);
+   if(pMap != MAP_FAILED)
+   {
+      mpData = (const char*)pMap;
+      mSize  = (size_t)st.st_size;
+   }
+#endif
+   if(mpData == NULL)
+   {
+      Close();
+      return false;
+   }
+
+   // Header and record table
+   const MorpheLibraryHeader *pHeader = (const MorpheLibraryHeader*)mpData;
+   if(!Contains(0, sizeof(MorpheLibraryHeader)) || memcmp(pHeader->magic, MORPHE_LIBRARY_MAGIC, 4) != 0 ||
+      pHeader->version != MORPHE_LIBRARY_VERSION ||
+      !Contains(pHeader->tableOffset, (unsigned long long)pHeader->itemCount * sizeof(MorpheLibraryRecord)))
+   {
+      Close();
+      return false;
+   }
+
+   const MorpheLibraryRecord *pRecords = (const MorpheLibraryRecord*)(mpData + pHeader->tableOffset);
+   mRecords.assign(pRecords, pRecords + pHeader->itemCount);
+   std::sort(mRecords.begin(), mRecords.end(), SortByIndex);
+   mVertexCount = pHeader->vertexCount;
+   return true;
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method unmaps the file.
+//
+void MorpheLibrary::Close()
+{
+#ifdef _WIN32
+   if(mpData != NULL)
+      UnmapViewOfFile(mpData);
+   if(mhMapping != NULL)
+      CloseHandle((HANDLE)mhMapping);
+   if(mhFile != NULL)
+      CloseHandle((HANDLE)mhFile);
+#else
+   if(mpData != NULL)
+      munmap((void*)mpData, mSize);
+#endif
+   mpData       = NULL;
+   mSize        = 0;
+   mhFile       = NULL;
+   mhMapping    = NULL;
+   mVertexCount = 0;
+   mRecords.clear();
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method finds the record of an item.
+//
+// Return Values:
+//    the record position, -1 if the library does not hold the item
+//
+int MorpheLibrary::Find(unsigned int uIndex) const
+{
+   MorpheLibraryRecord key;
+   key.index = uIndex;
+   std::vector<MorpheLibraryRecord>::const_iterator it = std::lower_bound(mRecords.begin(), mRecords.end(), key, SortByIndex);
+   if(it == mRecords.end() || it->index != uIndex)
+      return -1;
+   return (int)(it - mRecords.begin());
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method returns the name of the item at record k.
+//
+std::string MorpheLibrary::Name(unsigned int k) const
+{
+   const MorpheLibraryRecord &record = mRecords[k];
+   if(!Contains(record.nameOffset, record.nameLength))
+      return std::string();
+   return std::string(mpData + record.nameOffset, record.nameLength);
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method copies the item at record k out of the mapped file, with
+//      its segments built.
+//
+// Return Values:
+//    false if the record points outside the file or holds invalid data:
+//      weight ids out of range, sparse indices out of order or past the
+//      vertex count, or an in-between weight outside of ]0, 1[
+//
+bool MorpheLibrary::Load(unsigned int k, MorpheItem &item) const
+{
+   const MorpheLibraryRecord &record = mRecords[k];
+   if(!Contains(record.weightsOffset, (unsigned long long)record.weightCount * sizeof(int)) ||
+      !Contains(record.shapesOffset, (unsigned long long)record.shapeCount * sizeof(MorpheLibraryShape)))
+      return false;
+
+   const int *pIds = (const int*)(mpData + record.weightsOffset);
+   for(unsigned int i = 0; i < record.weightCount; i++)
+   {
+      if(pIds[i] < 0 || pIds[i] > MORPHE_LIBRARY_MAX_WEIGHT_ID)
+         return false;
+   }
+
+   item = MorpheItem();
+   if(record.weightCount > 0)
+      item.SetWeightIds(pIds, record.weightCount);
+
+   const MorpheLibraryShape *pShapes = (const MorpheLibraryShape*)(mpData + record.shapesOffset);
+   for(unsigned int s = 0; s < record.shapeCount; s++)
+   {
+      const MorpheLibraryShape &shape = pShapes[s];
+      unsigned long long uBytes = (unsigned long long)shape.count * sizeof(float);
+      if((shape.dense && shape.count != mVertexCount) || shape.count > mVertexCount ||
+         !(shape.weight == 1.0f || (shape.weight > 0.0f && shape.weight < 1.0f)) ||
+         !Contains(shape.deltasOffset, 3 * PaddedSize(uBytes)) ||
+         (!shape.dense && !Contains(shape.indicesOffset, (unsigned long long)shape.count * sizeof(unsigned int))))
+         return false;
+
+      // Sparse indices are scattered without checks by the kernels
+      const unsigned int *pIndices = shape.dense ? NULL : (const unsigned int*)(mpData + shape.indicesOffset);
+      for(unsigned int j = 0; pIndices != NULL && j < shape.count; j++)
+      {
+         if(pIndices[j] >= mVertexCount || (j > 0 && pIndices[j] <= pIndices[j-1]))
+            return false;
+      }
+
+      MorpheTarget &target = shape.weight == 1.0f ? item.target : item.AddInbetween(shape.weight);
+      const float *pX = (const float*)(mpData + shape.deltasOffset);
+      const float *pY = (const float*)(mpData + shape.deltasOffset + PaddedSize(uBytes));
+      const float *pZ = (const float*)(mpData + shape.deltasOffset + 2 * PaddedSize(uBytes));
+
+      target.Clear();
+      target.vertexCount = mVertexCount;
+      if(!shape.dense)
+         target.indices.assign(pIndices, pIndices + shape.count);
+      target.dx.assign(pX, pX + shape.count);
+      target.dy.assign(pY, pY + shape.count);
+      target.dz.assign(pZ, pZ + shape.count);
+   }
+
+   item.BuildSegments();
+   return true;
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method tells whether a block lies inside the mapped file.
+//
+bool MorpheLibrary::Contains(unsigned long long uOffset, unsigned long long uSize) const
+{
+   return uOffset <= mSize && uSize <= mSize - uOffset;
+}
+// -----------------------------------------------------------------------------
@@ -0,0 +1,120 @@
+// -----------------------------------------------------------------------------
+// MorpheLibrary.h - C++ File
+// -----------------------------------------------------------------------------
+
+#ifndef MORPHE_LIBRARY_H
+#define MORPHE_LIBRARY_H
+
+
+//
+// Includes
+//
+#include "MorpheItem.h"
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+// -----------------------------------------------------------------------------
+
+
+// File signature and format version of target libraries.
+#define MORPHE_LIBRARY_MAGIC     "MLIB"
+#define MORPHE_LIBRARY_VERSION   1
+
+// Largest weight id an item may use, larger ones mark a corrupt record.
+#define MORPHE_LIBRARY_MAX_WEIGHT_ID   0xFFFFF
+// -----------------------------------------------------------------------------
+
+
+//
+// Library file layout, native endianness, offsets from the start of the file:
+//
+//    MorpheLibraryHeader
+//    per item: name, weight ids, MorpheLibraryShape table, then per shape
+//              its indices (sparse only) and its dx, dy, dz blocks
+//    MorpheLibraryRecord table, one per item, at tableOffset
+//
+struct MorpheLibraryHeader
+{
+   char                 magic[4];
+   unsigned int         version;
+   unsigned int         itemCount;
+   unsigned int         vertexCount;
+   unsigned long long   tableOffset;
+};
+
+struct MorpheLibraryRecord
+{
+   unsigned int         index;            // morpheItem logical index
+   unsigned int         nameLength;
+   unsigned int         weightCount;
+   unsigned int         shapeCount;       // Target then in-betweens
+   unsigned long long   nameOffset;
+   unsigned long long   weightsOffset;
+   unsigned long long   shapesOffset;
+};
+
+struct MorpheLibraryShape
+{
+   float                weight;           // 1 for the target, else the in-between weight
+   unsigned int         count;            // Deltas stored
+   unsigned int         dense;            // One delta per vertex, no indices
+   unsigned int         reserved;
+   unsigned long long   indicesOffset;
+   unsigned long long   deltasOffset;
+};
+// -----------------------------------------------------------------------------
+
+
+//
+// MorpheLibraryEntry - An item to write to a library
+//
+struct MorpheLibraryEntry
+{
+   unsigned int         index;
+   std::string          name;
+   const MorpheItem     *item;
+};
+
+bool  MorpheWriteLibrary(const char *pPath, unsigned int uVertexCount, const std::vector<MorpheLibraryEntry> &entries);
+// -----------------------------------------------------------------------------
+
+
+//
+// MorpheLibrary - Read only view of a library file. The file is mapped in
+//    memory and only the record table is read when opening; the deltas of
+//    an item are paged in when it is loaded.
+//
+class MorpheLibrary
+{
+public:
+                  MorpheLibrary();
+                  ~MorpheLibrary();
+
+   bool           Open(const char *pPath);
+   void           Close();
+
+   bool           IsOpen() const                   { return mpData != NULL; }
+   unsigned int   ItemCount() const                { return (unsigned int)mRecords.size(); }
+   unsigned int   VertexCount() const              { return mVertexCount; }
+   int            Find(unsigned int uIndex) const;
+   unsigned int   Index(unsigned int k) const      { return mRecords[k].index; }
+   std::string    Name(unsigned int k) const;
+   bool           Load(unsigned int k, MorpheItem &item) const;
+
+private:
+                  MorpheLibrary(const MorpheLibrary&);
+   MorpheLibrary  &operator=(const MorpheLibrary&);
+
+   bool           Contains(unsigned long long uOffset, unsigned long long uSize) const;
+
+   const char                       *mpData;
+   size_t                           mSize;
+   void                             *mhFile;       // Windows file and mapping handles
+   void                             *mhMapping;
+   unsigned int                     mVertexCount;
+   std::vector<MorpheLibraryRecord> mRecords;     // Sorted by index
+};
+// -----------------------------------------------------------------------------
+
+#endif
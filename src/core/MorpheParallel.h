@@ -0,0 +1,31 @@
+// -----------------------------------------------------------------------------
+// MorpheParallel.h - C++ File
+// -----------------------------------------------------------------------------
+
+#ifndef MORPHE_PARALLEL_H
+#define MORPHE_PARALLEL_H
+
+
+// Vertices per parallel task. Fixed so results never depend on thread count.
+#define MORPHE_CHUNK_SIZE        4096
+// -----------------------------------------------------------------------------
+
+
+typedef void (*MorpheTaskFunc)(void *pData, unsigned int uTask);
+// -----------------------------------------------------------------------------
+
+
+//
+// MorpheParallel - Runs a set of independent tasks and waits for all of them.
+//    The core ships MorpheThreadPool, the plug-in wraps Maya's MThreadPool.
+//
+class MorpheParallel
+{
+public:
+   virtual        ~MorpheParallel() {}
+
+   virtual void   Run(unsigned int uTaskCount, MorpheTaskFunc func, void *pData) = 0;
+};
+// -----------------------------------------------------------------------------
+
+#endif
@@ -0,0 +1,109 @@
+// -----------------------------------------------------------------------------
+// MorphePointCache.cpp - C++ File
+// -----------------------------------------------------------------------------
+
+
+//
+// Includes
+//
+#include "MorphePointCache.h"
+
+#include <string.h>
+// -----------------------------------------------------------------------------
+
+
+//
+// Constructor / Destructor
+//
+MorphePointCacheWriter::MorphePointCacheWriter() : mpFile(NULL)
+{
+   memset(&mHeader, 0, sizeof(mHeader));
+}
+
+MorphePointCacheWriter::~MorphePointCacheWriter()
+{
+   Close();
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method creates the cache file and writes its header.
+//
+// Return Values:
+//    false if the file could not be written
+//
+bool MorphePointCacheWriter::Open(const char *pPath, unsigned int uPointCount, float fStartFrame, float fFrameStep)
+{
+   Close();
+
+   mpFile = fopen(pPath, "wb");
+   if(mpFile == NULL)
+      return false;
+
+   memcpy(mHeader.magic, MORPHE_POINT_CACHE_MAGIC, 4);
+   mHeader.version    = MORPHE_POINT_CACHE_VERSION;
+   mHeader.pointCount = uPointCount;
+   mHeader.frameCount = 0;
+   mHeader.startFrame = fStartFrame;
+   mHeader.frameStep  = fFrameStep;
+   mBuffer.resize(uPointCount * 3);
+
+   if(fwrite(&mHeader, sizeof(mHeader), 1, mpFile) != 1)
+   {
+      fclose(mpFile);
+      mpFile = NULL;
+      return false;
+   }
+   return true;
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method appends the next frame, given as structure of arrays.
+//
+// Return Values:
+//    false if the frame could not be written
+//
+bool MorphePointCacheWriter::WriteFrame(const float *pX, const float *pY, const float *pZ)
+{
+   if(mpFile == NULL)
+      return false;
+
+   for(unsigned int j = 0; j < mHeader.pointCount; j++)
+   {
+      mBuffer[3*j]   = pX[j];
+      mBuffer[3*j+1] = pY[j];
+      mBuffer[3*j+2] = pZ[j];
+   }
+
+   if(!mBuffer.empty() && fwrite(&mBuffer[0], sizeof(float), mBuffer.size(), mpFile) != mBuffer.size())
+      return false;
+
+   mHeader.frameCount++;
+   return true;
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method writes the final frame count and closes the file.
+//
+// Return Values:
+//    false if the header could not be updated
+//
+bool MorphePointCacheWriter::Close()
+{
+   if(mpFile == NULL)
+      return true;
+
+   bool bOk = fseek(mpFile, 0, SEEK_SET) == 0 && fwrite(&mHeader, sizeof(mHeader), 1, mpFile) == 1;
+   bOk = fclose(mpFile) == 0 && bOk;
+   mpFile = NULL;
+   return bOk;
+}
+// -----------------------------------------------------------------------------
@@ -0,0 +1,67 @@
+// -----------------------------------------------------------------------------
+// MorphePointCache.h - C++ File
+// -----------------------------------------------------------------------------
+
+#ifndef MORPHE_POINT_CACHE_H
+#define MORPHE_POINT_CACHE_H
+
+
+//
+// Includes
+//
+#include <stdio.h>
+#include <vector>
+// -----------------------------------------------------------------------------
+
+
+// File signature and format version of point caches.
+#define MORPHE_POINT_CACHE_MAGIC    "MPC1"
+#define MORPHE_POINT_CACHE_VERSION  1
+// -----------------------------------------------------------------------------
+
+
+//
+// MorphePointCacheHeader - Start of a point cache file, native endianness.
+//    Frames follow, each frame is pointCount xyz floats interleaved.
+//
+struct MorphePointCacheHeader
+{
+   char           magic[4];
+   unsigned int   version;
+   unsigned int   pointCount;
+   unsigned int   frameCount;
+   float          startFrame;
+   float          frameStep;
+};
+// -----------------------------------------------------------------------------
+
+
+//
+// MorphePointCacheWriter - Streams frames of points to a point cache file so
+//    a bake never holds more than one frame. The frame count is written by
+//    Close.
+//
+class MorphePointCacheWriter
+{
+public:
+                  MorphePointCacheWriter();
+                  ~MorphePointCacheWriter();
+
+   bool           Open(const char *pPath, unsigned int uPointCount, float fStartFrame, float fFrameStep);
+   bool           WriteFrame(const float *pX, const float *pY, const float *pZ);
+   bool           Close();
+
+   bool           IsOpen() const                   { return mpFile != NULL; }
+   unsigned int   FrameCount() const               { return mHeader.frameCount; }
+
+private:
+                  MorphePointCacheWriter(const MorphePointCacheWriter&);
+   MorphePointCacheWriter &operator=(const MorphePointCacheWriter&);
+
+   FILE                       *mpFile;
+   MorphePointCacheHeader     mHeader;
+   std::vector<float>         mBuffer;       // One interleaved frame
+};
+// -----------------------------------------------------------------------------
+
+#endif
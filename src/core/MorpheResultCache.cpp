@@ -0,0 +1,162 @@
+// -----------------------------------------------------------------------------
+// MorpheResultCache.cpp - C++ File
+// -----------------------------------------------------------------------------
+
+
+//
+// Includes
+//
+#include "MorpheResultCache.h"
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    Constructor.
+//
+MorpheResultCache::MorpheResultCache()
+   : mBudget(0), mSize(0), mHits(0), mMisses(0)
+{
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method drops every result. The hit counters are kept.
+//
+void MorpheResultCache::Clear()
+{
+   mEntries.clear();
+   mLookup.clear();
+   mSize = 0;
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method sets the memory budget, dropping the oldest results that no
+//      longer fit.
+//
+void MorpheResultCache::SetBudget(size_t uBytes)
+{
+   mBudget = uBytes;
+   Trim(mBudget);
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method hashes a key with 64-bit FNV-1a.
+//
+unsigned long long MorpheResultCache::Hash(const std::vector<unsigned int> &key)
+{
+   unsigned long long uHash = 14695981039346656037ULL;
+   for(size_t i = 0; i < key.size(); i++)
+   {
+      unsigned int uWord = key[i];
+      for(int b = 0; b < 4; b++, uWord >>= 8)
+      {
+         uHash ^= uWord & 0xff;
+         uHash *= 1099511628211ULL;
+      }
+   }
+   return uHash;
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method returns the memory counted for a result.
+//
+size_t MorpheResultCache::EntrySize(size_t uKeySize, size_t uValueCount)
+{
+   return sizeof(Entry) + uKeySize * sizeof(unsigned int) + uValueCount * sizeof(float);
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method drops the least recently used results until the cache fits
+//      in uBytes.
+//
+void MorpheResultCache::Trim(size_t uBytes)
+{
+   while(mSize > uBytes && !mEntries.empty())
+   {
+      Entry &entry = mEntries.back();
+
+      std::pair<EntryMap::iterator, EntryMap::iterator> range = mLookup.equal_range(entry.hash);
+      for(EntryMap::iterator it = range.first; it != range.second; it++)
+      {
+         if(&*it->second == &entry)
+         {
+            mLookup.erase(it);
+            break;
+         }
+      }
+
+      mSize -= EntrySize(entry.key.size(), entry.values.size());
+      mEntries.pop_back();
+   }
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method looks a result up and makes it the most recently used.
+//
+// Return Values:
+//    the values stored with the key, NULL on a miss
+//
+const std::vector<float> *MorpheResultCache::Find(const std::vector<unsigned int> &key)
+{
+   std::pair<EntryMap::iterator, EntryMap::iterator> range = mLookup.equal_range(Hash(key));
+   for(EntryMap::iterator it = range.first; it != range.second; it++)
+   {
+      if(it->second->key != key)
+         continue;
+
+      mEntries.splice(mEntries.begin(), mEntries, it->second);
+      mHits++;
+      return &mEntries.front().values;
+   }
+
+   mMisses++;
+   return NULL;
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method makes room for a result of uValueCount values, which the
+//      caller fills in. The oldest results are dropped to stay within the
+//      budget. The key must not be in the cache.
+//
+// Return Values:
+//    the values to fill in, NULL if the result alone is over budget
+//
+std::vector<float> *MorpheResultCache::Insert(const std::vector<unsigned int> &key, size_t uValueCount)
+{
+   size_t uEntrySize = EntrySize(key.size(), uValueCount);
+   if(uEntrySize > mBudget)
+      return NULL;
+   Trim(mBudget - uEntrySize);
+
+   mEntries.push_front(Entry());
+   Entry &entry = mEntries.front();
+   entry.hash = Hash(key);
+   entry.key  = key;
+   entry.values.resize(uValueCount);
+
+   mLookup.insert(EntryMap::value_type(entry.hash, mEntries.begin()));
+   mSize += uEntrySize;
+   return &entry.values;
+}
+// -----------------------------------------------------------------------------
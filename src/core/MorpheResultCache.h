@@ -0,0 +1,66 @@
+// -----------------------------------------------------------------------------
+// MorpheResultCache.h - C++ File
+// -----------------------------------------------------------------------------
+
+#ifndef MORPHE_RESULT_CACHE_H
+#define MORPHE_RESULT_CACHE_H
+
+
+//
+// Includes
+//
+#include <stddef.h>
+#include <list>
+#include <map>
+#include <vector>
+// -----------------------------------------------------------------------------
+
+
+//
+// MorpheResultCache - Evaluation results kept under a memory budget, least
+//    recently used first out. A key is any word sequence describing the
+//    inputs of a result; it is hashed for the lookup and compared in full,
+//    so a hash collision is never a hit.
+//
+class MorpheResultCache
+{
+public:
+                        MorpheResultCache();
+
+   void                 Clear();
+   void                 SetBudget(size_t uBytes);
+
+   const std::vector<float>   *Find(const std::vector<unsigned int> &key);
+   std::vector<float>         *Insert(const std::vector<unsigned int> &key, size_t uValueCount);
+
+   unsigned int         Count() const              { return (unsigned int)mEntries.size(); }
+   size_t               MemorySize() const         { return mSize; }
+   unsigned int         Hits() const               { return mHits; }
+   unsigned int         Misses() const             { return mMisses; }
+   void                 ResetStats()               { mHits = mMisses = 0; }
+
+private:
+   struct Entry
+   {
+      unsigned long long         hash;
+      std::vector<unsigned int>  key;
+      std::vector<float>         values;
+   };
+
+   typedef std::list<Entry>                                          EntryList;
+   typedef std::multimap<unsigned long long, EntryList::iterator>    EntryMap;
+
+   static unsigned long long  Hash(const std::vector<unsigned int> &key);
+   static size_t              EntrySize(size_t uKeySize, size_t uValueCount);
+   void                       Trim(size_t uBytes);
+
+   EntryList            mEntries;         // Most recently used first
+   EntryMap             mLookup;          // Hash -> entries
+   size_t               mBudget;
+   size_t               mSize;
+   unsigned int         mHits;
+   unsigned int         mMisses;
+};
+// -----------------------------------------------------------------------------
+
+#endif
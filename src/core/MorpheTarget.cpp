@@ -0,0 +1,355 @@
+// -----------------------------------------------------------------------------
+// MorpheTarget.cpp - C++ File
+// -----------------------------------------------------------------------------
+
+
+//
+// Includes
+//
+#include "MorpheTarget.h"
+
+#include <math.h>
+// -----------------------------------------------------------------------------
+
+
+//
+// Constructor
+//
+MorpheTarget::MorpheTarget() : vertexCount(0), qError(0.0f)
+{
+   for(int i = 0; i < 3; i++)
+   {
+      qOffset[i] = 0.0f;
+      qStep[i]   = 0.0f;
+   }
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method builds the deltas of a target against the base points,
+//      both given as xyz floats. Only vertices moved further than the
+//      threshold are kept; mostly moving targets are switched to dense.
+//
+void MorpheTarget::Build(const float *pTarget, const float *pBase, unsigned int uCount, unsigned int uVertexCount, float threshold)
+{
+   Clear();
+   vertexCount = uVertexCount;
+   if(vertexCount == 0)
+      return;
+
+   if(uCount > vertexCount)
+      uCount = vertexCount;
+
+   std::vector<float> fx(vertexCount, 0.0f), fy(vertexCount, 0.0f), fz(vertexCount, 0.0f);
+   for(unsigned int j = 0; j < uCount; j++)
+   {
+      fx[j] = pTarget[3*j]   - pBase[3*j];
+      fy[j] = pTarget[3*j+1] - pBase[3*j+1];
+      fz[j] = pTarget[3*j+2] - pBase[3*j+2];
+   }
+
+   MakeSparse(&fx[0], &fy[0], &fz[0], threshold);
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method builds the deltas from stored sparse data: vertex indices
+//      and their xyz deltas. Indices outside the base are dropped.
+//
+void MorpheTarget::Build(const int *pIndices, const float *pDeltas, unsigned int uDeltaCount, unsigned int uVertexCount)
+{
+   Clear();
+   vertexCount = uVertexCount;
+
+   for(unsigned int k = 0; k < uDeltaCount; k++)
+   {
+      if(pIndices[k] < 0 || (unsigned int)pIndices[k] >= vertexCount)
+         continue;
+
+      indices.push_back((unsigned int)pIndices[k]);
+      dx.push_back(pDeltas[3*k]);
+      dy.push_back(pDeltas[3*k+1]);
+      dz.push_back(pDeltas[3*k+2]);
+   }
+
+   // Stored data is not guaranteed to be sorted
+   for(size_t k = 1; k < indices.size(); k++)
+   {
+      if(indices[k-1] < indices[k])
+         continue;
+
+      MorpheTarget sorted;
+      sorted.vertexCount = vertexCount;
+      std::vector<int> slot(vertexCount, -1);
+      for(size_t n = 0; n < indices.size(); n++)
+         slot[indices[n]] = (int)n;
+      for(unsigned int j = 0; j < vertexCount; j++)
+      {
+         if(slot[j] < 0)
+            continue;
+         sorted.indices.push_back(j);
+         sorted.dx.push_back(dx[slot[j]]);
+         sorted.dy.push_back(dy[slot[j]]);
+         sorted.dz.push_back(dz[slot[j]]);
+      }
+      *this = sorted;
+      break;
+   }
+
+   if(indices.size() > vertexCount * MORPHE_DENSE_FRACTION)
+      MakeDense();
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method removes other deltas, scaled by weight, from this target,
+//      used to make a combination target relative to its parents.
+//
+void MorpheTarget::Subtract(const MorpheTarget &other, float weight, float threshold)
+{
+   if(other.Count() == 0 || vertexCount == 0)
+      return;
+
+   if(other.IsQuantized())
+   {
+      MorpheTarget expanded(other);
+      expanded.Dequantize();
+      Subtract(expanded, weight, threshold);
+      return;
+   }
+   Dequantize();
+
+   std::vector<float> fx(vertexCount, 0.0f), fy(vertexCount, 0.0f), fz(vertexCount, 0.0f);
+   for(unsigned int k = 0; k < Count(); k++)
+   {
+      fx[Index(k)] = dx[k];
+      fy[Index(k)] = dy[k];
+      fz[Index(k)] = dz[k];
+   }
+   for(unsigned int k = 0; k < other.Count(); k++)
+   {
+      unsigned int j = other.Index(k);
+      if(j >= vertexCount)
+         break;
+      fx[j] -= other.dx[k] * weight;
+      fy[j] -= other.dy[k] * weight;
+      fz[j] -= other.dz[k] * weight;
+   }
+
+   MakeSparse(&fx[0], &fy[0], &fz[0], threshold);
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method scales the deltas by per vertex weights, given sparsely:
+//      unlisted vertices keep a weight of 1. Vertices weighted down to
+//      nothing are dropped, so the weights cost nothing at evaluation.
+//
+void MorpheTarget::ApplyWeights(const unsigned int *pIndices, const float *pValues, unsigned int uCount, float threshold)
+{
+   if(uCount == 0 || Count() == 0)
+      return;
+   Dequantize();
+
+   std::vector<float> fx(vertexCount, 0.0f), fy(vertexCount, 0.0f), fz(vertexCount, 0.0f);
+   for(unsigned int k = 0; k < Count(); k++)
+   {
+      fx[Index(k)] = dx[k];
+      fy[Index(k)] = dy[k];
+      fz[Index(k)] = dz[k];
+   }
+   for(unsigned int k = 0; k < uCount; k++)
+   {
+      unsigned int j = pIndices[k];
+      if(j >= vertexCount)
+         continue;
+      fx[j] *= pValues[k];
+      fy[j] *= pValues[k];
+      fz[j] *= pValues[k];
+   }
+
+   MakeSparse(&fx[0], &fy[0], &fz[0], threshold);
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method empties the target.
+//
+void MorpheTarget::Clear()
+{
+   indices.clear();
+   dx.clear();
+   dy.clear();
+   dz.clear();
+   qx.clear();
+   qy.clear();
+   qz.clear();
+   qError = 0.0f;
+   vertexCount = 0;
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method quantizes one axis of deltas to 16-bit steps between its
+//      lowest and highest delta, and releases the floats.
+//
+// Return Values:
+//    the largest error of the quantized deltas
+//
+static float QuantizeAxis(std::vector<float> &d, std::vector<unsigned short> &q, float &offset, float &step)
+{
+   float fMin = d[0], fMax = d[0];
+   for(size_t k = 1; k < d.size(); k++)
+   {
+      if(d[k] < fMin)
+         fMin = d[k];
+      if(d[k] > fMax)
+         fMax = d[k];
+   }
+
+   offset = fMin;
+   step   = (fMax - fMin) / MORPHE_QUANTIZE_LEVELS;
+
+   float fError = 0.0f;
+   q.resize(d.size());
+   for(size_t k = 0; k < d.size(); k++)
+   {
+      float fLevel = step > 0.0f ? (d[k] - fMin) / step + 0.5f : 0.0f;
+      q[k] = (unsigned short)(fLevel < MORPHE_QUANTIZE_LEVELS ? fLevel : MORPHE_QUANTIZE_LEVELS);
+
+      float fDiff = fabsf(offset + q[k] * step - d[k]);
+      if(fDiff > fError)
+         fError = fDiff;
+   }
+
+   std::vector<float>().swap(d);
+   return fError;
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method replaces the float deltas by 16-bit steps within the bounds
+//      of each axis, halving the memory of the deltas.
+//
+// Return Values:
+//    the largest error of the quantized deltas
+//
+float MorpheTarget::Quantize()
+{
+   if(IsQuantized() || dx.empty())
+      return qError;
+
+   float fErrorX = QuantizeAxis(dx, qx, qOffset[0], qStep[0]);
+   float fErrorY = QuantizeAxis(dy, qy, qOffset[1], qStep[1]);
+   float fErrorZ = QuantizeAxis(dz, qz, qOffset[2], qStep[2]);
+
+   qError = fErrorX > fErrorY ? fErrorX : fErrorY;
+   if(fErrorZ > qError)
+      qError = fErrorZ;
+   return qError;
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method expands quantized deltas back to floats.
+//
+void MorpheTarget::Dequantize()
+{
+   if(!IsQuantized())
+      return;
+
+   size_t uCount = qx.size();
+   dx.resize(uCount);
+   dy.resize(uCount);
+   dz.resize(uCount);
+   for(size_t k = 0; k < uCount; k++)
+   {
+      dx[k] = qOffset[0] + qx[k] * qStep[0];
+      dy[k] = qOffset[1] + qy[k] * qStep[1];
+      dz[k] = qOffset[2] + qz[k] * qStep[2];
+   }
+
+   std::vector<unsigned short>().swap(qx);
+   std::vector<unsigned short>().swap(qy);
+   std::vector<unsigned short>().swap(qz);
+   qError = 0.0f;
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method returns the bytes held by the target data.
+//
+size_t MorpheTarget::MemorySize() const
+{
+   return indices.capacity() * sizeof(unsigned int) + (dx.capacity() + dy.capacity() + dz.capacity()) * sizeof(float) +
+          (qx.capacity() + qy.capacity() + qz.capacity()) * sizeof(unsigned short);
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method keeps the vertices of full arrays of deltas moved further
+//      than the threshold, or all of them when most of the base moves.
+//
+void MorpheTarget::MakeSparse(const float *pX, const float *pY, const float *pZ, float threshold)
+{
+   indices.clear();
+   dx.clear();
+   dy.clear();
+   dz.clear();
+
+   for(unsigned int j = 0; j < vertexCount; j++)
+   {
+      if(fabsf(pX[j]) <= threshold && fabsf(pY[j]) <= threshold && fabsf(pZ[j]) <= threshold)
+         continue;
+
+      indices.push_back(j);
+      dx.push_back(pX[j]);
+      dy.push_back(pY[j]);
+      dz.push_back(pZ[j]);
+   }
+
+   if(indices.size() > vertexCount * MORPHE_DENSE_FRACTION)
+      MakeDense();
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method expands sparse deltas to one delta per base vertex.
+//
+void MorpheTarget::MakeDense()
+{
+   std::vector<float> fx(vertexCount, 0.0f), fy(vertexCount, 0.0f), fz(vertexCount, 0.0f);
+   for(size_t k = 0; k < indices.size(); k++)
+   {
+      fx[indices[k]] = dx[k];
+      fy[indices[k]] = dy[k];
+      fz[indices[k]] = dz[k];
+   }
+   indices.clear();
+   dx.swap(fx);
+   dy.swap(fy);
+   dz.swap(fz);
+}
+// -----------------------------------------------------------------------------
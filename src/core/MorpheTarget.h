@@ -0,0 +1,88 @@
+// -----------------------------------------------------------------------------
+// MorpheTarget.h - C++ File
+// -----------------------------------------------------------------------------
+
+#ifndef MORPHE_TARGET_H
+#define MORPHE_TARGET_H
+
+
+//
+// Includes
+//
+#include <stddef.h>
+#include <vector>
+// -----------------------------------------------------------------------------
+
+
+// Deltas with every component under this length are treated as unmoved.
+#define MORPHE_ZERO_THRESHOLD    1.0e-5f
+
+// Targets moving more than this fraction of the base are stored dense.
+#define MORPHE_DENSE_FRACTION    0.5f
+
+// Highest step of quantized deltas.
+#define MORPHE_QUANTIZE_LEVELS   65535
+// -----------------------------------------------------------------------------
+
+
+//
+// MorpheTarget - Deltas of a single target, structure of arrays. Sparse
+//    targets keep the moved vertex indices, dense targets keep one delta
+//    per base vertex and no indices.
+//
+//    Quantized targets replace the float deltas by 16-bit steps within the
+//    bounds of each axis: delta = offset + q * step. Edits go through the
+//    float deltas again, so quantize once the target is final.
+//
+class MorpheTarget
+{
+public:
+                  MorpheTarget();
+
+   void           Build(const float *pTarget, const float *pBase, unsigned int uCount, unsigned int uVertexCount, float threshold);
+   void           Build(const int *pIndices, const float *pDeltas, unsigned int uDeltaCount, unsigned int uVertexCount);
+   void           Subtract(const MorpheTarget &other, float weight, float threshold);
+   void           ApplyWeights(const unsigned int *pIndices, const float *pValues, unsigned int uCount, float threshold);
+   void           Clear();
+   float          Quantize();
+   void           Dequantize();
+
+   bool           IsDense() const                  { return indices.empty() && Count() > 0; }
+   bool           IsQuantized() const              { return !qx.empty(); }
+   unsigned int   Count() const                    { return (unsigned int)(dx.size() + qx.size()); }
+   unsigned int   Index(unsigned int k) const      { return indices.empty() ? k : indices[k]; }
+   size_t         MemorySize() const;
+
+public:
+   std::vector<unsigned int>  indices;       // Moved vertex indices, ascending. Empty when dense.
+   std::vector<float>         dx, dy, dz;    // Delta per moved vertex, empty when quantized
+   unsigned int               vertexCount;   // Vertex count of the base it was built against
+
+   std::vector<unsigned short> qx, qy, qz;   // Quantized delta per moved vertex
+   float                      qOffset[3];    // Lowest delta of each axis
+   float                      qStep[3];      // Delta of one quantization step on each axis
+   float                      qError;        // Largest error of the quantized deltas
+
+private:
+   void           MakeDense();
+   void           MakeSparse(const float *pX, const float *pY, const float *pZ, float threshold);
+};
+// -----------------------------------------------------------------------------
+
+
+//
+// MorpheDeltas - Accumulated deltas of a geometry, structure of arrays
+//
+class MorpheDeltas
+{
+public:
+   void           Resize(unsigned int uCount)      { x.assign(uCount, 0.0f); y.assign(uCount, 0.0f); z.assign(uCount, 0.0f); }
+   void           Zero()                           { Resize(Count()); }
+   unsigned int   Count() const                    { return (unsigned int)x.size(); }
+
+public:
+   std::vector<float>         x, y, z;
+};
+// -----------------------------------------------------------------------------
+
+#endif
@@ -0,0 +1,122 @@
+// -----------------------------------------------------------------------------
+// MorpheThreadPool.cpp - C++ File
+// -----------------------------------------------------------------------------
+
+
+//
+// Includes
+//
+#include "MorpheThreadPool.h"
+// -----------------------------------------------------------------------------
+
+
+//
+// Constructor
+//    uThreadCount - total threads including the caller, 0 for all cores
+//
+MorpheThreadPool::MorpheThreadPool(unsigned int uThreadCount)
+   : mFunc(NULL), mData(NULL), mTaskCount(0), mNextTask(0), mBusy(0), mJob(0), mStop(false)
+{
+   if(uThreadCount == 0)
+      uThreadCount = std::thread::hardware_concurrency();
+   for(unsigned int i = 1; i < uThreadCount; i++)
+      mThreads.push_back(std::thread(&MorpheThreadPool::WorkerLoop, this));
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Destructor
+//
+MorpheThreadPool::~MorpheThreadPool()
+{
+   {
+      std::lock_guard<std::mutex> lock(mMutex);
+      mStop = true;
+   }
+   mWake.notify_all();
+   for(size_t i = 0; i < mThreads.size(); i++)
+      mThreads[i].join();
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method runs every task and returns once all of them are done.
+//
+void MorpheThreadPool::Run(unsigned int uTaskCount, MorpheTaskFunc func, void *pData)
+{
+   if(uTaskCount == 0)
+      return;
+
+   if(mThreads.empty() || uTaskCount == 1)
+   {
+      for(unsigned int t = 0; t < uTaskCount; t++)
+         func(pData, t);
+      return;
+   }
+
+   {
+      std::lock_guard<std::mutex> lock(mMutex);
+      mFunc      = func;
+      mData      = pData;
+      mTaskCount = uTaskCount;
+      mNextTask  = 0;
+      mBusy      = (unsigned int)mThreads.size();
+      mJob++;
+   }
+   mWake.notify_all();
+
+   RunTasks();
+
+   std::unique_lock<std::mutex> lock(mMutex);
+   while(mBusy > 0)
+      mDone.wait(lock);
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method takes tasks of the current job until none is left.
+//
+void MorpheThreadPool::RunTasks()
+{
+   for(;;)
+   {
+      unsigned int t = mNextTask++;
+      if(t >= mTaskCount)
+         break;
+      mFunc(mData, t);
+   }
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method is the body of the worker threads.
+//
+void MorpheThreadPool::WorkerLoop()
+{
+   unsigned long uLastJob = 0;
+   for(;;)
+   {
+      {
+         std::unique_lock<std::mutex> lock(mMutex);
+         while(!mStop && mJob == uLastJob)
+            mWake.wait(lock);
+         if(mStop)
+            return;
+         uLastJob = mJob;
+      }
+
+      RunTasks();
+
+      std::lock_guard<std::mutex> lock(mMutex);
+      if(--mBusy == 0)
+         mDone.notify_one();
+   }
+}
+// -----------------------------------------------------------------------------
@@ -0,0 +1,57 @@
+// -----------------------------------------------------------------------------
+// MorpheThreadPool.h - C++ File
+// -----------------------------------------------------------------------------
+
+#ifndef MORPHE_THREAD_POOL_H
+#define MORPHE_THREAD_POOL_H
+
+
+//
+// Includes
+//
+#include "MorpheParallel.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+// -----------------------------------------------------------------------------
+
+
+//
+// MorpheThreadPool - std::thread pool. The calling thread works too, so a
+//    pool of one thread runs everything inline.
+//
+class MorpheThreadPool : public MorpheParallel
+{
+public:
+   explicit       MorpheThreadPool(unsigned int uThreadCount = 0);
+   virtual        ~MorpheThreadPool();
+
+   unsigned int   ThreadCount() const              { return (unsigned int)mThreads.size() + 1; }
+   virtual void   Run(unsigned int uTaskCount, MorpheTaskFunc func, void *pData);
+
+private:
+                  MorpheThreadPool(const MorpheThreadPool&);
+   MorpheThreadPool &operator=(const MorpheThreadPool&);
+
+   void           WorkerLoop();
+   void           RunTasks();
+
+   std::vector<std::thread>   mThreads;
+   std::mutex                 mMutex;
+   std::condition_variable    mWake;
+   std::condition_variable    mDone;
+
+   MorpheTaskFunc             mFunc;
+   void                       *mData;
+   unsigned int               mTaskCount;
+   std::atomic<unsigned int>  mNextTask;
+   unsigned int               mBusy;         // Workers still inside the current job
+   unsigned long              mJob;          // Incremented on every Run
+   bool                       mStop;
+};
+// -----------------------------------------------------------------------------
+
+#endif
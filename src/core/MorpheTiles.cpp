@@ -0,0 +1,212 @@
+// -----------------------------------------------------------------------------
+// MorpheTiles.cpp - C++ File
+// -----------------------------------------------------------------------------
+
+
+//
+// Includes
+//
+#include "MorpheTiles.h"
+#include "MorpheKernels.h"
+// -----------------------------------------------------------------------------
+
+
+//
+// Accumulation task over a group of tiles
+//
+struct MorpheTilesTask
+{
+   const MorpheTiles::Entry   *entries;
+   const unsigned int         *tileStarts;
+   unsigned int               tileCount;
+   float                      *x, *y, *z;
+};
+
+static void AccumulateTiles(const MorpheTilesTask &task, unsigned int uBegin, unsigned int uEnd)
+{
+   const MorpheKernels &kernels = MorpheGetKernels();
+
+   if(uEnd > task.tileCount)
+      uEnd = task.tileCount;
+   for(unsigned int uTile = uBegin; uTile < uEnd; uTile++)
+   {
+      for(unsigned int e = task.tileStarts[uTile]; e < task.tileStarts[uTile + 1]; e++)
+      {
+         const MorpheTiles::Entry &entry = task.entries[e];
+         MorpheAccumulateSpan(kernels, *entry.target, entry.weight, entry.first, entry.last, task.x, task.y, task.z);
+      }
+   }
+}
+
+static void AccumulateTilesChunk(void *pData, unsigned int uTask)
+{
+   const unsigned int uTilesPerTask = MORPHE_CHUNK_SIZE / MORPHE_TILE_SIZE;
+   AccumulateTiles(*(MorpheTilesTask*)pData, uTask * uTilesPerTask, (uTask + 1) * uTilesPerTask);
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    Constructor.
+//
+MorpheTiles::MorpheTiles()
+   : mVertexCount(0)
+{
+   mColumnSpans.push_back(0);
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method forgets every target.
+//
+void MorpheTiles::Clear()
+{
+   mVertexCount = 0;
+   mColumns.clear();
+   mColumnSpans.assign(1, 0);
+   mSpans.clear();
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method splits a target in tiles.
+//
+// Return Values:
+//    the column of the target
+//
+unsigned int MorpheTiles::AddTarget(const MorpheTarget &target)
+{
+   unsigned int uColumn = (unsigned int)mColumnSpans.size() - 1;
+   unsigned int uCount  = target.Count();
+
+   Span span;
+   if(target.IsDense())
+   {
+      unsigned int uLast = uCount < mVertexCount ? uCount : mVertexCount;
+      for(span.first = 0, span.tile = 0; span.first < uLast; span.first += MORPHE_TILE_SIZE, span.tile++)
+      {
+         span.last = span.first + MORPHE_TILE_SIZE < uLast ? span.first + MORPHE_TILE_SIZE : uLast;
+         mSpans.push_back(span);
+      }
+   }
+   else
+   {
+      // Indices are ascending, a tile is one run of them
+      for(unsigned int k = 0; k < uCount;)
+      {
+         span.tile  = target.indices[k] / MORPHE_TILE_SIZE;
+         span.first = k;
+         while(k < uCount && target.indices[k] / MORPHE_TILE_SIZE == span.tile)
+            k++;
+         span.last = k;
+
+         // Deltas past the vertex count are dropped
+         if(target.indices[span.first] >= mVertexCount)
+            break;
+         while(target.indices[span.last - 1] >= mVertexCount)
+            span.last--;
+         mSpans.push_back(span);
+      }
+   }
+
+   mColumnSpans.push_back((unsigned int)mSpans.size());
+   mColumns[&target] = uColumn;
+   return uColumn;
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method adds every weighted target to the deltas, tile by tile.
+//      Within a tile the targets are added in term order, so the result is
+//      the same as MorpheAccumulate, bit for bit, whatever the number of
+//      threads. A parallel task covers MORPHE_CHUNK_SIZE vertices.
+//
+void MorpheTiles::Accumulate(const MorpheTermArray &terms, MorpheDeltas &deltas, MorpheParallel *pParallel)
+{
+   if(deltas.Count() != mVertexCount)
+   {
+      Clear();
+      mVertexCount = deltas.Count();
+   }
+
+   unsigned int uTileCount = (mVertexCount + MORPHE_TILE_SIZE - 1) / MORPHE_TILE_SIZE;
+   if(uTileCount == 0)
+      return;
+
+   // Columns of the terms, new targets are split on first use
+   std::vector<unsigned int> columns(terms.size(), 0);
+   mTileStarts.assign(uTileCount + 1, 0);
+   for(size_t t = 0; t < terms.size(); t++)
+   {
+      const MorpheTarget *pTarget = terms[t].target;
+      if(terms[t].weight == 0.0f || pTarget->Count() == 0)
+      {
+         columns[t] = (unsigned int)-1;
+         continue;
+      }
+
+      std::map<const MorpheTarget*, unsigned int>::const_iterator it = mColumns.find(pTarget);
+      columns[t] = it != mColumns.end() ? it->second : AddTarget(*pTarget);
+      for(unsigned int s = mColumnSpans[columns[t]]; s < mColumnSpans[columns[t] + 1]; s++)
+         mTileStarts[mSpans[s].tile + 1]++;
+   }
+
+   // Active spans sorted by tile, in term order within a tile
+   for(unsigned int uTile = 0; uTile < uTileCount; uTile++)
+      mTileStarts[uTile + 1] += mTileStarts[uTile];
+   if(mTileStarts[uTileCount] == 0)
+      return;
+
+   std::vector<unsigned int> cursors(mTileStarts.begin(), mTileStarts.end() - 1);
+   mEntries.resize(mTileStarts[uTileCount]);
+   for(size_t t = 0; t < terms.size(); t++)
+   {
+      if(columns[t] == (unsigned int)-1)
+         continue;
+
+      for(unsigned int s = mColumnSpans[columns[t]]; s < mColumnSpans[columns[t] + 1]; s++)
+      {
+         const Span &span = mSpans[s];
+         Entry &entry = mEntries[cursors[span.tile]++];
+         entry.target = terms[t].target;
+         entry.weight = terms[t].weight;
+         entry.first  = span.first;
+         entry.last   = span.last;
+      }
+   }
+
+   MorpheTilesTask task;
+   task.entries    = &mEntries[0];
+   task.tileStarts = &mTileStarts[0];
+   task.tileCount  = uTileCount;
+   task.x          = &deltas.x[0];
+   task.y          = &deltas.y[0];
+   task.z          = &deltas.z[0];
+
+   const unsigned int uTilesPerTask = MORPHE_CHUNK_SIZE / MORPHE_TILE_SIZE;
+   unsigned int uTaskCount = (uTileCount + uTilesPerTask - 1) / uTilesPerTask;
+   if(pParallel == NULL || uTaskCount < 2)
+      AccumulateTiles(task, 0, uTileCount);
+   else
+      pParallel->Run(uTaskCount, AccumulateTilesChunk, &task);
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method returns the memory used by the tile spans.
+//
+size_t MorpheTiles::MemorySize() const
+{
+   return mSpans.capacity() * sizeof(Span) + mColumnSpans.capacity() * sizeof(unsigned int) +
+          mEntries.capacity() * sizeof(Entry) + mTileStarts.capacity() * sizeof(unsigned int);
+}
+// -----------------------------------------------------------------------------
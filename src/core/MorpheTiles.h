@@ -0,0 +1,72 @@
+// -----------------------------------------------------------------------------
+// MorpheTiles.h - C++ File
+// -----------------------------------------------------------------------------
+
+#ifndef MORPHE_TILES_H
+#define MORPHE_TILES_H
+
+
+//
+// Includes
+//
+#include "MorpheAccumulator.h"
+
+#include <map>
+#include <vector>
+// -----------------------------------------------------------------------------
+
+
+// Vertices per tile, the deltas of a tile stay in L1 while its targets are added.
+#define MORPHE_TILE_SIZE         256
+// -----------------------------------------------------------------------------
+
+
+//
+// MorpheTiles - Targets split in tiles of MORPHE_TILE_SIZE vertices. Every
+//    target known to the tiles keeps the delta positions it has in each
+//    tile it moves, found once when the target is first accumulated.
+//    Evaluation then walks the tiles, each with the list of its active
+//    targets, and never visits a tile no active target moves. The targets
+//    must stay alive until Clear is called.
+//
+class MorpheTiles
+{
+public:
+                  MorpheTiles();
+
+   void           Clear();
+   void           Accumulate(const MorpheTermArray &terms, MorpheDeltas &deltas, MorpheParallel *pParallel = NULL);
+
+   unsigned int   TargetCount() const              { return (unsigned int)mColumns.size(); }
+   size_t         MemorySize() const;
+
+public:
+   struct Span
+   {
+      unsigned int      tile;
+      unsigned int      first;            // Delta positions in the target
+      unsigned int      last;
+   };
+
+   struct Entry
+   {
+      const MorpheTarget   *target;
+      float                weight;
+      unsigned int         first;
+      unsigned int         last;
+   };
+
+private:
+   unsigned int   AddTarget(const MorpheTarget &target);
+
+   unsigned int                                 mVertexCount;
+   std::map<const MorpheTarget*, unsigned int>  mColumns;       // Target -> column
+   std::vector<unsigned int>                    mColumnSpans;   // Column -> first span, column count + 1
+   std::vector<Span>                            mSpans;         // By column, then tile
+
+   std::vector<unsigned int>                    mTileStarts;    // Evaluation scratch: tile -> first entry
+   std::vector<Entry>                           mEntries;       // Evaluation scratch: active spans by tile
+};
+// -----------------------------------------------------------------------------
+
+#endif
@@ -0,0 +1,170 @@
+// -----------------------------------------------------------------------------
+// MorpheWeightIndex.cpp - C++ File
+// -----------------------------------------------------------------------------
+
+
+//
+// Includes
+//
+#include "MorpheWeightIndex.h"
+
+#include <algorithm>
+// -----------------------------------------------------------------------------
+
+
+//
+// Constructor
+//
+MorpheWeightIndex::MorpheWeightIndex() : mStamp(0) {}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method empties the index.
+//
+void MorpheWeightIndex::Clear()
+{
+   mItems.clear();
+   mByWeight.clear();
+   mExpressions.clear();
+   mVisited.clear();
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method adds an item and the weight ids driving it. The weight of
+//      an item with a non empty expression is the expression instead of the
+//      product of its weights. An item already in the index must not be
+//      added again.
+//
+void MorpheWeightIndex::SetItem(unsigned int uItem, const int *pIds, unsigned int uCount, const MorpheExpression *pExpression)
+{
+   unsigned int uSlot = (unsigned int)mItems.size();
+   mItems.push_back(Entry());
+   mItems.back().item = uItem;
+   mItems.back().weightIds.assign(pIds, pIds + uCount);
+   mVisited.push_back(0);
+
+   if(pExpression && !pExpression->IsEmpty())
+   {
+      mItems.back().expression = *pExpression;
+      mExpressions.push_back(uSlot);
+      return;
+   }
+
+   for(unsigned int i = 0; i < uCount; i++)
+   {
+      if(pIds[i] < 0)
+         continue;
+      if((unsigned int)pIds[i] >= mByWeight.size())
+         mByWeight.resize(pIds[i] + 1);
+
+      std::vector<unsigned int> &slots = mByWeight[pIds[i]];
+      if(slots.empty() || slots.back() != uSlot)
+         slots.push_back(uSlot);
+   }
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method returns the items whose weight is not zero, parents first
+//      then combinations by number of weights.
+//
+void MorpheWeightIndex::GetActive(const std::vector<float> &weights, MorpheActiveArray &active) const
+{
+   active.clear();
+   if(++mStamp == 0)
+   {
+      std::fill(mVisited.begin(), mVisited.end(), 0);
+      mStamp = 1;
+   }
+
+   unsigned int uWeightCount = (unsigned int)std::min(weights.size(), mByWeight.size());
+   for(unsigned int w = 0; w < uWeightCount; w++)
+   {
+      if(weights[w] == 0.0f)
+         continue;
+
+      const std::vector<unsigned int> &slots = mByWeight[w];
+      for(size_t s = 0; s < slots.size(); s++)
+      {
+         unsigned int uSlot = slots[s];
+         if(mVisited[uSlot] == mStamp)
+            continue;
+         mVisited[uSlot] = mStamp;
+
+         const Entry &entry = mItems[uSlot];
+         float wt = 1.0f;
+         for(size_t i = 0; i < entry.weightIds.size() && wt != 0.0f; i++)
+         {
+            int id = entry.weightIds[i];
+            wt *= (id >= 0 && (size_t)id < weights.size()) ? weights[id] : 0.0f;
+         }
+         if(wt == 0.0f)
+            continue;
+
+         MorpheActiveItem item;
+         item.weightCount = (unsigned int)entry.weightIds.size();
+         item.item        = entry.item;
+         item.weight      = wt;
+         active.push_back(item);
+      }
+   }
+
+   // Expressions in one pass over their items
+   for(size_t e = 0; e < mExpressions.size(); e++)
+   {
+      const Entry &entry = mItems[mExpressions[e]];
+      float wt = entry.expression.Evaluate(weights);
+      if(wt == 0.0f)
+         continue;
+
+      MorpheActiveItem item;
+      item.weightCount = (unsigned int)entry.weightIds.size();
+      item.item        = entry.item;
+      item.weight      = wt;
+      active.push_back(item);
+   }
+
+   std::sort(active.begin(), active.end());
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method returns every item driven by a strict subset of sorted
+//      weight ids, whatever its weight or expression, fewest weights first.
+//      These are the parents a combination is made relative to.
+//
+void MorpheWeightIndex::GetParents(const std::vector<int> &weightIds, std::vector<unsigned int> &parents) const
+{
+   MorpheActiveArray found;
+   std::vector<int> ids;
+   for(size_t e = 0; e < mItems.size(); e++)
+   {
+      ids = mItems[e].weightIds;
+      std::sort(ids.begin(), ids.end());
+      ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+      if(ids.empty() || ids.size() >= weightIds.size() ||
+         !std::includes(weightIds.begin(), weightIds.end(), ids.begin(), ids.end()))
+         continue;
+
+      MorpheActiveItem item;
+      item.weightCount = (unsigned int)ids.size();
+      item.item        = mItems[e].item;
+      item.weight      = 0.0f;
+      found.push_back(item);
+   }
+
+   std::sort(found.begin(), found.end());
+   parents.clear();
+   for(size_t i = 0; i < found.size(); i++)
+      parents.push_back(found[i].item);
+}
+// -----------------------------------------------------------------------------
@@ -0,0 +1,71 @@
+// -----------------------------------------------------------------------------
+// MorpheWeightIndex.h - C++ File
+// -----------------------------------------------------------------------------
+
+#ifndef MORPHE_WEIGHT_INDEX_H
+#define MORPHE_WEIGHT_INDEX_H
+
+
+//
+// Includes
+//
+#include "MorpheExpression.h"
+
+#include <vector>
+// -----------------------------------------------------------------------------
+
+
+//
+// MorpheActiveItem - An item whose weight is not zero
+//
+struct MorpheActiveItem
+{
+   unsigned int   weightCount;   // Number of weights driving the item
+   unsigned int   item;          // Item index
+   float          weight;        // Product of its weights, or its expression
+
+   bool operator<(const MorpheActiveItem &other) const
+   {
+      return weightCount != other.weightCount ? weightCount < other.weightCount : item < other.item;
+   }
+};
+
+typedef std::vector<MorpheActiveItem> MorpheActiveArray;
+// -----------------------------------------------------------------------------
+
+
+//
+// MorpheWeightIndex - Items reachable from each weight id, so only the items
+//    of non zero weights are visited. Items weighted by an expression may
+//    be non zero whatever their weights and are evaluated on every query.
+//
+class MorpheWeightIndex
+{
+public:
+                  MorpheWeightIndex();
+
+   void           Clear();
+   void           SetItem(unsigned int uItem, const int *pIds, unsigned int uCount, const MorpheExpression *pExpression = NULL);
+   unsigned int   ItemCount() const                { return (unsigned int)mItems.size(); }
+   unsigned int   WeightCount() const              { return (unsigned int)mByWeight.size(); }
+
+   void           GetActive(const std::vector<float> &weights, MorpheActiveArray &active) const;
+   void           GetParents(const std::vector<int> &weightIds, std::vector<unsigned int> &parents) const;
+
+private:
+   struct Entry
+   {
+      unsigned int      item;
+      std::vector<int>  weightIds;
+      MorpheExpression  expression;
+   };
+
+   std::vector<Entry>                        mItems;
+   std::vector< std::vector<unsigned int> >  mByWeight;     // Weight id -> entries
+   std::vector<unsigned int>                 mExpressions;  // Entries with an expression
+   mutable std::vector<unsigned int>         mVisited;      // Entry -> last query stamp
+   mutable unsigned int                      mStamp;
+};
+// -----------------------------------------------------------------------------
+
+#endif
@@ -0,0 +1,38 @@
+// -----------------------------------------------------------------------------
+// MorpheWeightMap.cpp - C++ File
+// -----------------------------------------------------------------------------
+
+
+//
+// Includes
+//
+#include "MorpheWeightMap.h"
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method sets every vertex to the same weight.
+//
+void MorpheWeightMap::Reset(unsigned int uCount, float fDefault)
+{
+   values.assign(uCount, fDefault);
+   indices.clear();
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method lists the affected vertices once all weights are set.
+//
+void MorpheWeightMap::Finalize()
+{
+   indices.clear();
+   for(unsigned int j = 0; j < values.size(); j++)
+   {
+      if(values[j] > 0.0f)
+         indices.push_back(j);
+   }
+}
+// -----------------------------------------------------------------------------
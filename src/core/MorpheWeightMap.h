@@ -0,0 +1,35 @@
+// -----------------------------------------------------------------------------
+// MorpheWeightMap.h - C++ File
+// -----------------------------------------------------------------------------
+
+#ifndef MORPHE_WEIGHT_MAP_H
+#define MORPHE_WEIGHT_MAP_H
+
+
+//
+// Includes
+//
+#include <vector>
+// -----------------------------------------------------------------------------
+
+
+//
+// MorpheWeightMap - Per vertex deformer weights with the list of vertices
+//    that are affected at all.
+//
+class MorpheWeightMap
+{
+public:
+   void           Reset(unsigned int uCount, float fDefault);
+   void           Set(unsigned int j, float wt)     { if(j < values.size()) values[j] = wt; }
+   void           Finalize();
+
+   unsigned int   Count() const                    { return (unsigned int)values.size(); }
+
+public:
+   std::vector<float>         values;        // One weight per vertex
+   std::vector<unsigned int>  indices;       // Vertices with a weight above zero, ascending
+};
+// -----------------------------------------------------------------------------
+
+#endif
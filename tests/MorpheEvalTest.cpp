@@ -0,0 +1,252 @@
+// -----------------------------------------------------------------------------
+// MorpheEvalTest.cpp - C++ File
+//    Runs morphe_eval on a generated rig and compares its point cache with
+//    two references: the frames evaluated in process the way
+//    MorpheNode::deform does, which must match bit for bit, and a plain
+//    double precision blend, which must match within float precision.
+//
+//    usage: morphe_eval_test MORPHE_EVAL WORK_FOLDER
+// -----------------------------------------------------------------------------
+
+
+//
+// Includes
+//
+#include "MorpheAccumulator.h"
+#include "MorpheExpression.h"
+#include "MorpheItem.h"
+#include "MorphePointCache.h"
+#include "MorpheWeightIndex.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+// -----------------------------------------------------------------------------
+
+
+#define TEST_VERTEX_COUNT     3000
+#define TEST_TARGET_COUNT     4
+#define TEST_FRAME_COUNT      8
+#define TEST_EXPRESSION_ITEM  3
+#define TEST_EXPRESSION       "clamp(w[0] * 2, 0, 1)"
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method returns a coordinate of the generated meshes. Every value
+//      is a multiple of 1/64, exact as a float and as OBJ text, and targets
+//      only move some of the vertices.
+//
+static double TestPoint(unsigned int uMesh, unsigned int j, unsigned int a)
+{
+   double dBase = (double)((j * 7 + a * 13) % 512) / 64.0 - 4.0;
+   if(uMesh == 0 || (j + uMesh) % (uMesh + 2) != 0)
+      return dBase;
+   return dBase + (double)((int)((j * 5 + a * 3 + uMesh * 11) % 129) - 64) / 64.0;
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method returns the weight of a generated frame, in [-0.5, 1.5].
+//
+static float TestWeight(unsigned int f, unsigned int w)
+{
+   return (float)((f * 37 + w * 101) % 33) / 16.0f - 0.5f;
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method writes a generated mesh as OBJ vertices, 0 being the base.
+//
+static bool WriteObj(const std::string &path, unsigned int uMesh)
+{
+   FILE *pFile = fopen(path.c_str(), "w");
+   if(pFile == NULL)
+      return false;
+   for(unsigned int j = 0; j < TEST_VERTEX_COUNT; j++)
+      fprintf(pFile, "v %.17g %.17g %.17g\n", TestPoint(uMesh, j, 0), TestPoint(uMesh, j, 1), TestPoint(uMesh, j, 2));
+   return fclose(pFile) == 0;
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method reads every frame of a point cache.
+//
+static bool ReadPointCache(const std::string &path, MorphePointCacheHeader &header, std::vector<float> &points)
+{
+   FILE *pFile = fopen(path.c_str(), "rb");
+   if(pFile == NULL)
+      return false;
+
+   bool bOk = fread(&header, sizeof(header), 1, pFile) == 1 && memcmp(header.magic, MORPHE_POINT_CACHE_MAGIC, 4) == 0;
+   if(bOk)
+   {
+      points.resize((size_t)header.frameCount * header.pointCount * 3);
+      bOk = points.empty() || fread(&points[0], sizeof(float), points.size(), pFile) == points.size();
+   }
+   fclose(pFile);
+   return bOk;
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method runs morphe_eval and checks its cache against both
+//      references.
+//
+// Return Values:
+//    the number of failures
+//
+static int CheckEval(const std::string &command, const std::string &cachePath, const std::vector<float> &exact, const std::vector<double> &blend)
+{
+   if(system(command.c_str()) != 0)
+   {
+      fprintf(stderr, "FAIL: %s\n", command.c_str());
+      return 1;
+   }
+
+   MorphePointCacheHeader  header;
+   std::vector<float>      points;
+   if(!ReadPointCache(cachePath, header, points) || header.pointCount != TEST_VERTEX_COUNT ||
+      header.frameCount != TEST_FRAME_COUNT || points.size() != exact.size())
+   {
+      fprintf(stderr, "FAIL: %s is not the expected point cache\n", cachePath.c_str());
+      return 1;
+   }
+
+   unsigned int uExact = 0;
+   double       dError = 0.0;
+   for(size_t k = 0; k < points.size(); k++)
+   {
+      uExact += memcmp(&points[k], &exact[k], sizeof(float)) != 0;
+      dError  = fmax(dError, fabs(points[k] - blend[k]));
+   }
+   if(uExact > 0 || dError > 1e-5)
+   {
+      fprintf(stderr, "FAIL: %s, %u values differ from deform, %g from the blend\n", command.c_str(), uExact, dError);
+      return 1;
+   }
+
+   printf("ok: %s, largest difference to the blend %g\n", command.c_str(), dError);
+   return 0;
+}
+// -----------------------------------------------------------------------------
+
+
+int main(int argc, char **argv)
+{
+   if(argc != 3)
+   {
+      fprintf(stderr, "usage: morphe_eval_test MORPHE_EVAL WORK_FOLDER\n");
+      return 1;
+   }
+   std::string evalPath(argv[1]), folder(argv[2]);
+   folder += "/";
+
+   // Base, targets and weights, the CSV header names the targets out of order
+   std::string targetArgs;
+   for(unsigned int m = 0; m <= TEST_TARGET_COUNT; m++)
+   {
+      char name[32];
+      sprintf(name, m == 0 ? "base.obj" : "target%u.obj", m - 1);
+      if(!WriteObj(folder + name, m))
+      {
+         fprintf(stderr, "FAIL: cannot write %s%s\n", folder.c_str(), name);
+         return 1;
+      }
+      if(m > 0)
+         targetArgs += " --target \"" + folder + name + "\"";
+   }
+
+   FILE *pWeights = fopen((folder + "weights.csv").c_str(), "w");
+   if(pWeights == NULL)
+      return 1;
+   fprintf(pWeights, "target2,0,target3,target1\n");
+   const unsigned int columns[TEST_TARGET_COUNT] = { 2, 0, 3, 1 };
+   for(unsigned int f = 0; f < TEST_FRAME_COUNT; f++)
+   {
+      for(unsigned int c = 0; c < TEST_TARGET_COUNT; c++)
+         fprintf(pWeights, c > 0 ? ",%.9g" : "%.9g", TestWeight(f, columns[c]));
+      fprintf(pWeights, "\n");
+   }
+   fclose(pWeights);
+
+   // Reference of deform: the same items, terms and per frame accumulation
+   std::vector<float> baseXYZ, targetXYZ;
+   for(unsigned int j = 0; j < TEST_VERTEX_COUNT; j++)
+      for(unsigned int a = 0; a < 3; a++)
+         baseXYZ.push_back((float)TestPoint(0, j, a));
+
+   std::vector<MorpheItem> items(TEST_TARGET_COUNT);
+   MorpheExpression        expression;
+   MorpheWeightIndex       index;
+   expression.Compile(TEST_EXPRESSION);
+   for(unsigned int t = 0; t < TEST_TARGET_COUNT; t++)
+   {
+      targetXYZ.clear();
+      for(unsigned int j = 0; j < TEST_VERTEX_COUNT; j++)
+         for(unsigned int a = 0; a < 3; a++)
+            targetXYZ.push_back((float)TestPoint(t + 1, j, a));
+
+      int iWeightId = (int)t;
+      items[t].SetWeightIds(&iWeightId, 1);
+      items[t].target.Build(&targetXYZ[0], &baseXYZ[0], TEST_VERTEX_COUNT, TEST_VERTEX_COUNT, MORPHE_ZERO_THRESHOLD);
+      items[t].BuildSegments();
+      index.SetItem(t, &iWeightId, 1, t == TEST_EXPRESSION_ITEM ? &expression : NULL);
+   }
+
+   std::vector<float>   exact;
+   std::vector<double>  blend;
+   for(unsigned int f = 0; f < TEST_FRAME_COUNT; f++)
+   {
+      std::vector<float> weights(TEST_TARGET_COUNT);
+      for(unsigned int w = 0; w < TEST_TARGET_COUNT; w++)
+         weights[w] = TestWeight(f, w);
+
+      MorpheActiveArray active;
+      MorpheTermArray   terms;
+      MorpheDeltas      deltas;
+      index.GetActive(weights, active);
+      for(size_t a = 0; a < active.size(); a++)
+         items[active[a].item].GetTerms(active[a].weight, 1.0f, terms);
+      deltas.Resize(TEST_VERTEX_COUNT);
+      MorpheAccumulate(terms, deltas);
+
+      for(unsigned int j = 0; j < TEST_VERTEX_COUNT; j++)
+      {
+         const float *pDelta[3] = { &deltas.x[j], &deltas.y[j], &deltas.z[j] };
+         for(unsigned int a = 0; a < 3; a++)
+         {
+            double dBase = TestPoint(0, j, a), dPoint = dBase;
+            for(unsigned int t = 0; t < TEST_TARGET_COUNT; t++)
+            {
+               double dWeight = t == TEST_EXPRESSION_ITEM ? fmin(fmax(weights[0] * 2.0, 0.0), 1.0) : weights[t];
+               dPoint += dWeight * (TestPoint(t + 1, j, a) - dBase);
+            }
+            exact.push_back((float)(dBase + *pDelta[a]));
+            blend.push_back(dPoint);
+         }
+      }
+   }
+
+   // Single and multi threaded runs
+   std::string command = "\"" + evalPath + "\" --base \"" + folder + "base.obj\"" + targetArgs +
+                         " --weights \"" + folder + "weights.csv\" --expression \"3=" TEST_EXPRESSION "\"";
+   std::string cachePath = folder + "eval.mpc";
+   int iFailures = 0;
+   iFailures += CheckEval(command + " --threads 1 --output \"" + cachePath + "\"", cachePath, exact, blend);
+   iFailures += CheckEval(command + " --threads 4 --output \"" + cachePath + "\"", cachePath, exact, blend);
+   return iFailures == 0 ? 0 : 1;
+}
+// -----------------------------------------------------------------------------
@@ -0,0 +1,163 @@
+// -----------------------------------------------------------------------------
+// MorpheItemTest.cpp - C++ File
+//    Builds combination items with in-betweens from full sculpts, makes
+//    them relative with MorpheItem::MakeCorrective, and checks that the
+//    rig evaluated at each sculpted pose gives the sculpt back.
+//
+//    usage: morphe_item_test
+// -----------------------------------------------------------------------------
+
+
+//
+// Includes
+//
+#include "MorpheAccumulator.h"
+#include "MorpheItem.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <vector>
+// -----------------------------------------------------------------------------
+
+
+#define TEST_VERTEX_COUNT     300
+#define TEST_TOLERANCE        1e-5
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method returns a coordinate of a generated shape, as a delta from
+//      the base. Shapes move different vertices.
+//
+static float TestShape(unsigned int uShape, unsigned int j, unsigned int a)
+{
+   if((j + uShape) % 3 == 0)
+      return 0.0f;
+   return (float)((int)((j * 7 + a * 3 + uShape * 11) % 17) - 8) / 16.0f;
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method returns the points of a sculpt, the sum of weighted shapes.
+//
+static std::vector<float> TestSculpt(const unsigned int *pShapes, const float *pWeights, unsigned int uCount)
+{
+   std::vector<float> xyz((size_t)TEST_VERTEX_COUNT * 3, 0.0f);
+   for(unsigned int s = 0; s < uCount; s++)
+      for(unsigned int j = 0; j < TEST_VERTEX_COUNT; j++)
+         for(unsigned int a = 0; a < 3; a++)
+            xyz[j*3+a] += pWeights[s] * TestShape(pShapes[s], j, a);
+   return xyz;
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method sets a shape of an item from the points of its sculpt.
+//
+static void BuildShape(MorpheTarget &target, const std::vector<float> &xyz)
+{
+   std::vector<float> base(xyz.size(), 0.0f);
+   target.Build(&xyz[0], &base[0], TEST_VERTEX_COUNT, TEST_VERTEX_COUNT, MORPHE_ZERO_THRESHOLD);
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method evaluates the items at a pose, every weight at the same
+//      value, and compares the points with a sculpt.
+//
+// Return Values:
+//    the number of failures
+//
+static int CheckPose(const char *pName, const std::vector<const MorpheItem*> &items, float wt, const std::vector<float> &sculpt)
+{
+   MorpheTermArray terms;
+   for(size_t i = 0; i < items.size(); i++)
+      items[i]->GetTerms(powf(wt, (float)items[i]->weightIds.size()), 1.0f, terms);
+
+   MorpheDeltas deltas;
+   deltas.Resize(TEST_VERTEX_COUNT);
+   MorpheAccumulate(terms, deltas);
+
+   double dError = 0.0;
+   for(unsigned int j = 0; j < TEST_VERTEX_COUNT; j++)
+   {
+      dError = fmax(dError, fabs(deltas.x[j] - sculpt[j*3]));
+      dError = fmax(dError, fabs(deltas.y[j] - sculpt[j*3+1]));
+      dError = fmax(dError, fabs(deltas.z[j] - sculpt[j*3+2]));
+   }
+   if(dError > TEST_TOLERANCE)
+   {
+      fprintf(stderr, "FAIL: %s at %g, largest difference to the sculpt %g\n", pName, wt, dError);
+      return 1;
+   }
+
+   printf("ok: %s at %g, largest difference to the sculpt %g\n", pName, wt, dError);
+   return 0;
+}
+// -----------------------------------------------------------------------------
+
+
+int main()
+{
+   // A has an in-between at 0.5, B and C have none. Shapes 5 and 7 are the
+   // corrections of AB and ABC at 1, 6 and 8 those at their in-betweens,
+   // sculpted with every weight at 0.5.
+   const int ids[3] = { 0, 1, 2 };
+   MorpheItem a, b, c, ab, abc;
+   a.SetWeightIds(&ids[0], 1);
+   b.SetWeightIds(&ids[1], 1);
+   c.SetWeightIds(&ids[2], 1);
+   ab.SetWeightIds(&ids[0], 2);
+   abc.SetWeightIds(&ids[0], 3);
+
+   const unsigned int   aShapes[1]     = { 2 };
+   const unsigned int   aHalfShapes[1] = { 1 };
+   const unsigned int   bShapes[1]     = { 3 };
+   const unsigned int   cShapes[1]     = { 4 };
+   const float          ones[5]        = { 1.0f, 1.0f, 1.0f, 1.0f, 1.0f };
+   BuildShape(a.target, TestSculpt(aShapes, ones, 1));
+   BuildShape(a.AddInbetween(0.5f), TestSculpt(aHalfShapes, ones, 1));
+   BuildShape(b.target, TestSculpt(bShapes, ones, 1));
+   BuildShape(c.target, TestSculpt(cShapes, ones, 1));
+
+   const unsigned int   abShapes[3]       = { 2, 3, 5 };
+   const unsigned int   abHalfShapes[3]   = { 1, 3, 6 };
+   const float          abHalfWeights[3]  = { 1.0f, 0.5f, 1.0f };
+   const unsigned int   abcShapes[5]      = { 2, 3, 4, 5, 7 };
+   const unsigned int   abcHalfShapes[5]  = { 1, 3, 4, 6, 8 };
+   const float          abcHalfWeights[5] = { 1.0f, 0.5f, 0.5f, 1.0f, 1.0f };
+   std::vector<float> abSculpt      = TestSculpt(abShapes, ones, 3);
+   std::vector<float> abHalfSculpt  = TestSculpt(abHalfShapes, abHalfWeights, 3);
+   std::vector<float> abcSculpt     = TestSculpt(abcShapes, ones, 5);
+   std::vector<float> abcHalfSculpt = TestSculpt(abcHalfShapes, abcHalfWeights, 5);
+   BuildShape(ab.target, abSculpt);
+   BuildShape(ab.AddInbetween(0.25f), abHalfSculpt);
+   BuildShape(abc.target, abcSculpt);
+   BuildShape(abc.AddInbetween(0.125f), abcHalfSculpt);
+
+   MorpheItem *pItems[5] = { &a, &b, &c, &ab, &abc };
+   std::vector<const MorpheItem*> items(pItems, pItems + 5);
+   for(unsigned int i = 0; i < 5; i++)
+   {
+      pItems[i]->BuildSegments();
+      pItems[i]->MakeCorrective(items, MORPHE_ZERO_THRESHOLD);
+   }
+
+   std::vector<const MorpheItem*> abItems(pItems, pItems + 2);
+   abItems.push_back(&ab);
+
+   int iFailures = 0;
+   iFailures += CheckPose("ab", abItems, 1.0f, abSculpt);
+   iFailures += CheckPose("ab", abItems, 0.5f, abHalfSculpt);
+   iFailures += CheckPose("abc", items, 1.0f, abcSculpt);
+   iFailures += CheckPose("abc", items, 0.5f, abcHalfSculpt);
+   return iFailures == 0 ? 0 : 1;
+}
+// -----------------------------------------------------------------------------
@@ -0,0 +1,611 @@
+// -----------------------------------------------------------------------------
+// MorpheEval.cpp - C++ File
+//    Offline evaluator, without Maya. Reads a base mesh and its targets,
+//    evaluates one frame per row of weights and streams the deformed points
+//    to a point cache. Frames are evaluated as MorpheNode::deform does.
+//    Painted deformer weights are not in the library and are not applied,
+//    so the points are the same as the plug-in's, bit for bit on the same
+//    kernels, for unpainted deformers only.
+// -----------------------------------------------------------------------------
+
+
+//
+// Includes
+//
+#include "MorpheAccumulator.h"
+#include "MorpheExpression.h"
+#include "MorpheItem.h"
+#include "MorpheKernels.h"
+#include "MorpheLibrary.h"
+#include "MorphePointCache.h"
+#include "MorpheThreadPool.h"
+#include "MorpheTiles.h"
+#include "MorpheWeightIndex.h"
+
+#include <chrono>
+#include <ctype.h>
+#include <map>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+// -----------------------------------------------------------------------------
+
+
+//
+// Settings - Command line options
+//
+struct Settings
+{
+   const char                 *basePath;
+   std::vector<const char*>   targetPaths;      // OBJ targets, one weight each
+   const char                 *libraryPath;
+   const char                 *weightsPath;     // CSV, or binary with binaryWeights
+   bool                       binaryWeights;
+   const char                 *outputPath;
+   std::vector<std::string>   expressions;      // item=expression
+   float                      envelope;
+   float                      startFrame;
+   float                      frameStep;
+   unsigned int               threadCount;      // 0 for all cores
+   bool                       quantize;
+   const char                 *kernels;
+};
+// -----------------------------------------------------------------------------
+
+
+//
+// Rig - Base points and the items deforming them
+//
+struct Rig
+{
+   unsigned int                        vertexCount;
+   std::vector<double>                 baseXYZ;       // As Maya holds the input points
+   MorpheItemMap                       items;
+   std::map<std::string, unsigned int> weightIds;     // Item name -> weight id of single weight items
+   MorpheWeightIndex                   index;
+};
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method reads the vertex positions of an OBJ file.
+//
+// Return Values:
+//    true on success
+//
+static bool ReadObjPoints(const char *pPath, std::vector<double> &xyz)
+{
+   xyz.clear();
+   FILE *pFile = fopen(pPath, "r");
+   if(pFile == NULL)
+      return false;
+
+   char line[1024];
+   while(fgets(line, sizeof(line), pFile) != NULL)
+   {
+      if(line[0] != 'v' || (line[1] != ' ' && line[1] != '\t'))
+         continue;
+
+      double p[3];
+      char   *pText = line + 2;
+      for(int a = 0; a < 3; a++)
+         p[a] = strtod(pText, &pText);
+      xyz.insert(xyz.end(), p, p + 3);
+   }
+
+   bool bOk = !ferror(pFile);
+   fclose(pFile);
+   return bOk && !xyz.empty();
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method converts points to the xyz floats used by the core, see
+//      MorpheNode::GetFloatPoints.
+//
+static void GetFloatPoints(const std::vector<double> &xyz, std::vector<float> &floats)
+{
+   floats.resize(xyz.size());
+   for(size_t k = 0; k < xyz.size(); k++)
+      floats[k] = (float)xyz[k];
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method returns the name of a file without its folder and
+//      extension.
+//
+static std::string BaseName(const char *pPath)
+{
+   std::string name(pPath);
+   size_t uSlash = name.find_last_of("/\\");
+   if(uSlash != std::string::npos)
+      name = name.substr(uSlash + 1);
+   size_t uDot = name.find_last_of('.');
+   if(uDot != std::string::npos && uDot > 0)
+      name = name.substr(0, uDot);
+   return name;
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method builds one item per OBJ target, as live target meshes
+//      connected in order are: item and weight i for target i.
+//
+// Return Values:
+//    true on success
+//
+static bool LoadObjTargets(const Settings &settings, Rig &rig)
+{
+   std::vector<float>   baseXYZ, targetXYZ;
+   std::vector<double>  targetPoints;
+   GetFloatPoints(rig.baseXYZ, baseXYZ);
+
+   for(unsigned int t = 0; t < settings.targetPaths.size(); t++)
+   {
+      if(!ReadObjPoints(settings.targetPaths[t], targetPoints))
+      {
+         fprintf(stderr, "error: cannot read %s\n", settings.targetPaths[t]);
+         return false;
+      }
+      GetFloatPoints(targetPoints, targetXYZ);
+
+      int iWeightId = (int)t;
+      MorpheItem &item = rig.items[t];
+      item.SetWeightIds(&iWeightId, 1);
+      item.target.Build(&targetXYZ[0], &baseXYZ[0], (unsigned int)targetXYZ.size() / 3, rig.vertexCount, MORPHE_ZERO_THRESHOLD);
+      item.BuildSegments();
+      rig.weightIds[BaseName(settings.targetPaths[t])] = t;
+   }
+   return true;
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method loads every item of a target library, see
+//      morphe -exportLibrary.
+//
+// Return Values:
+//    true on success
+//
+static bool LoadLibraryTargets(const Settings &settings, Rig &rig)
+{
+   MorpheLibrary library;
+   if(!library.Open(settings.libraryPath))
+   {
+      fprintf(stderr, "error: cannot read target library %s\n", settings.libraryPath);
+      return false;
+   }
+   if(library.VertexCount() != rig.vertexCount)
+   {
+      fprintf(stderr, "error: %s has %u vertices, the base has %u\n", settings.libraryPath, library.VertexCount(), rig.vertexCount);
+      return false;
+   }
+
+   for(unsigned int k = 0; k < library.ItemCount(); k++)
+   {
+      MorpheItem &item = rig.items[library.Index(k)];
+      if(!library.Load(k, item))
+      {
+         fprintf(stderr, "error: cannot read item %u of %s\n", library.Index(k), settings.libraryPath);
+         return false;
+      }
+      if(item.weightIds.size() == 1)
+         rig.weightIds[library.Name(k)] = (unsigned int)item.weightIds[0];
+   }
+   return true;
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// Description:
+//    This method indexes the items by weight id, with their expressions, as
+//      MorpheNode::BuildWeightIndex does.
+//
+// Return Values:
+//    true on success
+//
+static bool IndexItems(const Settings &settings, Rig &rig)
+{
+   std::map<unsigned int, MorpheExpression> expressions;
+   for(size_t e = 0; e < settings.expressions.size(); e++)
+   {
+      const std::string &text = settings.expressions[e];
+      size_t uEqual = text.find('=');
+      std::string sError;
+      if(uEqual == std::string::npos || !isdigit((unsigned char)text[0]) ||
+         !expressions[(unsigned int)atoi(text.c_str())].Compile(text.c_str() + uEqual + 1, &sError))
+      {
+         fprintf(stderr, "error: expression %s: %s\n", text.c_str(), sError.empty() ? "item=expression expected" : sError.c_str());
+         return false;
+      }
+   }
+
+   rig.index.Clear();
+   for(MorpheItemMap::const_iterator it = rig.items.begin(); it != rig.items.end(); it++)
+   {
+      const MorpheItem &item = it->second;
+      std::map<unsigned int, MorpheExpression>::const_iterator itExpr = expressions.find(it->first);
+      const MorpheExpression *pExpression = itExpr != expressions.end() ? &itExpr->second : NULL;
+      if(!item.weightIds.empty() || pExpression != NULL)
+         rig.index.SetItem(it->first, item.weightIds.empty() ? NULL : &item.weightIds[0], (unsigned int)item.weightIds.size(), pExpression);
+   }
+   return true;
+}
+// -----------------------------------------------------------------------------
+
+
+//
+// WeightReader - Streams the weights of one frame at a time.
+//
+//    CSV: one row per frame. An optional first row names the columns,
+//    each by weight id or by item name; without it column i is weight i.
+//    Empty lines and lines starting with # are skipped.
+//
+//    Binary: an unsigned int weight count, then that many floats per frame,
+//    native endianness.
+//
+//    A path of - reads stdin.
+//
+class WeightReader
+{
+public:
+   WeightReader() : mpFile(NULL), mBinary(false), mPending(false), mLine(0), mWeightCount(0) {}
+   ~WeightReader()                                 { if(mpFile != NULL && mpFile != stdin) fclose(mpFile); }
+
+   bool Open(const char *pPath, bool bBinary, const Rig &rig)
+   {
+      mBinary = bBinary;
+      if(strcmp(pPath, "-") == 0)
+      {
+         mpFile = stdin;
+#ifdef _WIN32
+         if(bBinary)
+            _setmode(_fileno(stdin), _O_BINARY);
+#endif
+      }
+      else
+         mpFile = fopen(pPath, bBinary ? "rb" : "r");
+      if(mpFile == NULL)
+      {
+         fprintf(stderr, "error: cannot read %s\n", pPath);
+         return false;
+      }
+
+      if(mBinary)
+      {
+         unsigned int uCount;
+         if(fread(&uCount, sizeof(uCount), 1, mpFile) != 1)
+         {
+            fprintf(stderr, "error: %s has no weight count\n", pPath);
+            return false;
+         }
+         mColumns.resize(uCount);
+         for(unsigned int c = 0; c < uCount; c++)
+            mColumns[c] = c;
+         mValues.resize(uCount);
+         mWeightCount = uCount;
+         return true;
+      }
+
+      // Column names, or the first frame
+      if(!ReadFields())
+         return true;
+      char *pEnd;
+      strtod(mFields[0].c_str(), &pEnd);
+      bool bHeader = pEnd == mFields[0].c_str();
+
+      mColumns.resize(mFields.size());
+      for(size_t c = 0; c < mFields.size(); c++)
+      {
+         if(!bHeader)
+            mColumns[c] = (unsigned int)c;
+         else if(!mFields[c].empty() && mFields[c].find_first_not_of("0123456789") == std::string::npos)
+            mColumns[c] = (unsigned int)atoi(mFields[c].c_str());
+         else
+         {
+            std::map<std::string, unsigned int>::const_iterator it = rig.weightIds.find(mFields[c]);
+            if(it == rig.weightIds.end())
+            {
+               fprintf(stderr, "error: no single weight item named %s\n", mFields[c].c_str());
+               return false;
+            }
+            mColumns[c] = it->second;
+         }
+         if(mColumns[c] + 1 > mWeightCount)
+            mWeightCount = mColumns[c] + 1;
+      }
+      mPending = !bHeader;
+      return true;
+   }
+
+   //
+   // Reads the next frame into weights, indexed by weight id. Returns false
+   // at the end of the stream; error tells whether it was malformed.
+   //
+   bool Next(std::vector<float> &weights, bool &error)
+   {
+      error = false;
+      weights.assign(mWeightCount, 0.0f);
+
+      if(mBinary)
+      {
+         size_t uRead = mValues.empty() ? 0 : fread(&mValues[0], sizeof(float), mValues.size(), mpFile);
+         if(uRead != mValues.size() || mValues.empty())
+         {
+            error = uRead != 0;
+            if(error)
+               fprintf(stderr, "error: truncated frame in binary weights\n");
+            return false;
+         }
+         for(size_t c = 0; c < mColumns.size(); c++)
+            weights[mColumns[c]] = mValues[c];
+         return true;
+      }
+
+      if(!mPending && !ReadFields())
+         return false;
+      mPending = false;
+      if(mFields.size() != mColumns.size())
+      {
+         fprintf(stderr, "error: line %u has %u values, %u expected\n", mLine, (unsigned int)mFields.size(), (unsigned int)mColumns.size());
+         error = true;
+         return false;
+      }
+      for(size_t c = 0; c < mFields.size(); c++)
+      {
+         char *pEnd;
+         weights[mColumns[c]] = (float)strtod(mFields[c].c_str(), &pEnd);
+         if(pEnd == mFields[c].c_str())
+         {
+            fprintf(stderr, "error: line %u, %s is not a number\n", mLine, mFields[c].c_str());
+            error = true;
+            return false;
+         }
+      }
+      return true;
+   }
+
+private:
+   //
+   // Splits the next CSV line that is not empty nor a comment
+   //
+   bool ReadFields()
+   {
+      std::string line;
+      char        buffer[4096];
+      for(;;)
+      {
+         line.clear();
+         while(fgets(buffer, sizeof(buffer), mpFile) != NULL)
+         {
+            line += buffer;
+            if(!line.empty() && line[line.size() - 1] == '\n')
+               break;
+         }
+         if(line.empty())
+            return false;
+         mLine++;
+
+         size_t uEnd = line.find_last_not_of(" \t\r\n");
+         if(uEnd == std::string::npos || line[line.find_first_not_of(" \t")] == '#')
+            continue;
+         line.resize(uEnd + 1);
+         break;
+      }
+
+      mFields.clear();
+      for(size_t uFirst = 0;;)
+      {
+         size_t uComma = line.find(',', uFirst);
+         std::string field = line.substr(uFirst, uComma == std::string::npos ? std::string::npos : uComma - uFirst);
+         size_t uStart = field.find_first_not_of(" \t");
+         size_t uStop  = field.find_last_not_of(" \t");
+         mFields.push_back(uStart == std::string::npos ? std::string() : field.substr(uStart, uStop - uStart + 1));
+         if(uComma == std::string::npos)
+            break;
+         uFirst = uComma + 1;
+      }
+      return true;
+   }
+
+   FILE                       *mpFile;
+   bool                       mBinary;
+   bool                       mPending;      // First CSV row is a frame
+   unsigned int               mLine;
+   unsigned int               mWeightCount;  // Largest weight id + 1
+   std::vector<unsigned int>  mColumns;      // Column -> weight id
+   std::vector<std::string>   mFields;
+   std::vector<float>         mValues;
+};
+// -----------------------------------------------------------------------------
+
+
+static void PrintUsage()
+{
+   fprintf(stderr,
+      "usage: morphe_eval --base BASE.obj (--target T.obj ... | --library LIB.morphe)\n"
+      "                   --weights FILE --output OUT.mpc [options]\n"
+      "   --base PATH            base mesh, OBJ\n"
+      "   --target PATH          OBJ target driven by the next weight id, repeatable\n"
+      "   --library PATH         target library written by morphe -exportLibrary\n"
+      "   --weights PATH         CSV weights, one row per frame, - for stdin\n"
+      "   --binary-weights       read the weights as binary, see MorpheEval.cpp\n"
+      "   --expression I=EXPR    weight expression of item I, repeatable\n"
+      "   --output PATH          point cache to write, see MorphePointCache.h\n"
+      "   --envelope F           envelope of every frame (1)\n"
+      "   --start F              first frame number stored in the cache (1)\n"
+      "   --step F               frame step stored in the cache (1)\n"
+      "   --threads N            threads, 0 for all cores (0)\n"
+      "   --quantize             quantize the targets, as compression quantized16\n"
+      "   --kernels NAME         scalar, sse or avx2 (best for this CPU)\n"
+      "Painted deformer weights are not applied, the points match the plug-in\n"
+      "for unpainted deformers only.\n");
+}
+// -----------------------------------------------------------------------------
+
+
+int main(int argc, char **argv)
+{
+   Settings settings;
+   settings.basePath      = NULL;
+   settings.libraryPath   = NULL;
+   settings.weightsPath   = NULL;
+   settings.binaryWeights = false;
+   settings.outputPath    = NULL;
+   settings.envelope      = 1.0f;
+   settings.startFrame    = 1.0f;
+   settings.frameStep     = 1.0f;
+   settings.threadCount   = 0;
+   settings.quantize      = false;
+   settings.kernels       = NULL;
+
+   for(int i = 1; i < argc; i++)
+   {
+      bool bValue = i + 1 < argc;
+      if(strcmp(argv[i], "--base") == 0 && bValue)
+         settings.basePath = argv[++i];
+      else if(strcmp(argv[i], "--target") == 0 && bValue)
+         settings.targetPaths.push_back(argv[++i]);
+      else if(strcmp(argv[i], "--library") == 0 && bValue)
+         settings.libraryPath = argv[++i];
+      else if(strcmp(argv[i], "--weights") == 0 && bValue)
+         settings.weightsPath = argv[++i];
+      else if(strcmp(argv[i], "--binary-weights") == 0)
+         settings.binaryWeights = true;
+      else if(strcmp(argv[i], "--expression") == 0 && bValue)
+         settings.expressions.push_back(argv[++i]);
+      else if(strcmp(argv[i], "--output") == 0 && bValue)
+         settings.outputPath = argv[++i];
+      else if(strcmp(argv[i], "--envelope") == 0 && bValue)
+         settings.envelope = (float)atof(argv[++i]);
+      else if(strcmp(argv[i], "--start") == 0 && bValue)
+         settings.startFrame = (float)atof(argv[++i]);
+      else if(strcmp(argv[i], "--step") == 0 && bValue)
+         settings.frameStep = (float)atof(argv[++i]);
+      else if(strcmp(argv[i], "--threads") == 0 && bValue)
+         settings.threadCount = (unsigned int)atoi(argv[++i]);
+      else if(strcmp(argv[i], "--quantize") == 0)
+         settings.quantize = true;
+      else if(strcmp(argv[i], "--kernels") == 0 && bValue)
+         settings.kernels = argv[++i];
+      else
+      {
+         PrintUsage();
+         return 1;
+      }
+   }
+
+   if(settings.basePath == NULL || settings.weightsPath == NULL || settings.outputPath == NULL ||
+      settings.targetPaths.empty() == (settings.libraryPath == NULL))
+   {
+      PrintUsage();
+      return 1;
+   }
+   if(settings.kernels != NULL && !MorpheSelectKernels(settings.kernels))
+   {
+      fprintf(stderr, "error: kernels %s are not supported here\n", settings.kernels);
+      return 1;
+   }
+
+   // Base and targets
+   Rig rig;
+   if(!ReadObjPoints(settings.basePath, rig.baseXYZ))
+   {
+      fprintf(stderr, "error: cannot read %s\n", settings.basePath);
+      return 1;
+   }
+   rig.vertexCount = (unsigned int)rig.baseXYZ.size() / 3;
+
+   bool bLoaded = settings.libraryPath != NULL ? LoadLibraryTargets(settings, rig) : LoadObjTargets(settings, rig);
+   if(!bLoaded || !IndexItems(settings, rig))
+      return 1;
+   if(settings.quantize)
+   {
+      for(MorpheItemMap::iterator it = rig.items.begin(); it != rig.items.end(); it++)
+         it->second.Quantize();
+   }
+
+   WeightReader reader;
+   if(!reader.Open(settings.weightsPath, settings.binaryWeights, rig))
+      return 1;
+
+   MorphePointCacheWriter writer;
+   if(!writer.Open(settings.outputPath, rig.vertexCount, settings.startFrame, settings.frameStep))
+   {
+      fprintf(stderr, "error: cannot write %s\n", settings.outputPath);
+      return 1;
+   }
+
+   // One frame at a time, as deform: active items, their terms, the deltas
+   // accumulated by tiles and added to the double precision base points
+   MorpheThreadPool     pool(settings.threadCount);
+   MorpheTiles          tiles;
+   MorpheActiveArray    active;
+   MorpheTermArray      terms;
+   MorpheDeltas         deltas;
+   std::vector<float>   weights, px(rig.vertexCount), py(rig.vertexCount), pz(rig.vertexCount);
+   bool                 bError = false;
+
+   std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+   while(reader.Next(weights, bError))
+   {
+      terms.clear();
+      if(settings.envelope > 0.0f)
+      {
+         rig.index.GetActive(weights, active);
+         for(size_t a = 0; a < active.size(); a++)
+         {
+            MorpheItemMap::const_iterator it = rig.items.find(active[a].item);
+            if(it != rig.items.end())
+               it->second.GetTerms(active[a].weight, settings.envelope, terms);
+         }
+      }
+
+      deltas.Resize(rig.vertexCount);
+      if(!terms.empty())
+         tiles.Accumulate(terms, deltas, &pool);
+
+      for(unsigned int j = 0; j < rig.vertexCount; j++)
+      {
+         px[j] = (float)(rig.baseXYZ[3*j]   + deltas.x[j]);
+         py[j] = (float)(rig.baseXYZ[3*j+1] + deltas.y[j]);
+         pz[j] = (float)(rig.baseXYZ[3*j+2] + deltas.z[j]);
+      }
+
+      if(!writer.WriteFrame(&px[0], &py[0], &pz[0]))
+      {
+         fprintf(stderr, "error: cannot write %s\n", settings.outputPath);
+         return 1;
+      }
+   }
+
+   if(!writer.Close())
+   {
+      fprintf(stderr, "error: cannot write %s\n", settings.outputPath);
+      return 1;
+   }
+
+   double dSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+   fprintf(stderr, "%u frames of %u points, %u items, %u threads, %.3f s\n",
+           writer.FrameCount(), rig.vertexCount, (unsigned int)rig.items.size(), pool.ThreadCount(), dSeconds);
+   return bError ? 1 : 0;
+}
+// -----------------------------------------------------------------------------